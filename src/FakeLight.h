@@ -33,6 +33,11 @@ public:
         attenuationLinear = linear;
         attenuationQuadratic = quadratic;
     }
+    
+    // Constant, linear and quadratic attenuation terms
+    Vector3 GetAttenuation() const {
+        return Vector3 { attenuationConstant, attenuationLinear, attenuationQuadratic };
+    }
 
 private:
     LightType lightType;
@@ -0,0 +1,86 @@
+#include "background.h"
+#include "FakeLight.h"
+#include <rlgl.h>
+#include <cmath>
+
+// Texture coordinates carry pixel positions, so the gradient does not depend
+// on the framebuffer size or orientation
+static const char* BACKGROUND_FRAGMENT_SHADER = R"(
+#version 330
+
+in vec2 fragTexCoord;
+out vec4 finalColor;
+
+uniform vec2 lightPos;
+uniform float maxRadius;
+uniform float steps;
+uniform vec4 centerColor;
+uniform vec4 edgeColor;
+
+void main()
+{
+    // Same banding as concentric circles: t=0.0 at the light, t=1.0 at maxRadius
+    float t = ceil(distance(fragTexCoord, lightPos) / maxRadius * steps) / steps;
+    finalColor = vec4(mix(centerColor.rgb, edgeColor.rgb, clamp(t, 0.0, 1.0)), 1.0);
+}
+)";
+
+Background::~Background() {
+    if (loaded) UnloadShader(shader);
+}
+
+void Background::Load() {
+    loaded = true;
+    
+    // nullptr selects raylib's default vertex shader
+    shader = LoadShaderFromMemory(nullptr, BACKGROUND_FRAGMENT_SHADER);
+    lightPosLoc = GetShaderLocation(shader, "lightPos");
+    maxRadiusLoc = GetShaderLocation(shader, "maxRadius");
+    stepsLoc = GetShaderLocation(shader, "steps");
+    centerColorLoc = GetShaderLocation(shader, "centerColor");
+    edgeColorLoc = GetShaderLocation(shader, "edgeColor");
+}
+
+void Background::Draw(const FakeLight* light, Color baseColor, const Camera2D& camera,
+                      float width, float height, float radius) {
+    if (!light || light->GetType() != LightType::Point) {
+        ClearBackground(baseColor);
+        return;
+    }
+    
+    if (!loaded) Load();
+    if (!IsShaderValid(shader)) {
+        ClearBackground(baseColor);
+        return;
+    }
+    
+    // The quad is drawn in screen space, so bring the light and radius onto the screen
+    Vector2 lightPos = GetWorldToScreen2D(light->GetPosition(), camera);
+    Vector4 centerColor = ColorNormalize(ColorBrightness(baseColor, 0.3f));  // 30% brighter at center
+    Vector4 edgeColor = ColorNormalize(ColorBrightness(baseColor, -0.4f));   // 40% darker at edges
+    float maxRadius = radius * camera.zoom;
+    float steps = (float)GRADIENT_STEPS;
+    
+    SetShaderValue(shader, lightPosLoc, &lightPos, SHADER_UNIFORM_VEC2);
+    SetShaderValue(shader, maxRadiusLoc, &maxRadius, SHADER_UNIFORM_FLOAT);
+    SetShaderValue(shader, stepsLoc, &steps, SHADER_UNIFORM_FLOAT);
+    SetShaderValue(shader, centerColorLoc, &centerColor, SHADER_UNIFORM_VEC4);
+    SetShaderValue(shader, edgeColorLoc, &edgeColor, SHADER_UNIFORM_VEC4);
+    
+    // One full-screen quad, covering every pixel so no clear is needed
+    BeginShaderMode(shader);
+    rlSetTexture(rlGetTextureIdDefault());
+    rlBegin(RL_QUADS);
+    rlColor4ub(255, 255, 255, 255);
+    rlTexCoord2f(0.0f, 0.0f);
+    rlVertex2f(0.0f, 0.0f);
+    rlTexCoord2f(0.0f, height);
+    rlVertex2f(0.0f, height);
+    rlTexCoord2f(width, height);
+    rlVertex2f(width, height);
+    rlTexCoord2f(width, 0.0f);
+    rlVertex2f(width, 0.0f);
+    rlEnd();
+    rlSetTexture(0);
+    EndShaderMode();
+}
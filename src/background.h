@@ -0,0 +1,37 @@
+#pragma once
+
+#include <raylib.h>
+
+class FakeLight;
+
+// Radial gradient background centred on a point light
+// Evaluated per pixel in a fragment shader so the whole background costs a
+// single full-screen quad instead of dozens of overlapping circles
+class Background {
+public:
+    Background() = default;
+    ~Background();
+
+    Background(const Background&) = delete;
+    Background& operator=(const Background&) = delete;
+
+    // Draw the gradient around a point light over the whole screen, or clear
+    // to baseColor otherwise
+    // The light sits in the world seen through camera, radius is the
+    // gradient's extent in world pixels
+    void Draw(const FakeLight* light, Color baseColor, const Camera2D& camera,
+              float width, float height, float radius);
+
+private:
+    Shader shader = {};
+    bool loaded = false;  // The shader needs a GL context, so it loads on first draw
+    int lightPosLoc = -1;
+    int maxRadiusLoc = -1;
+    int stepsLoc = -1;
+    int centerColorLoc = -1;
+    int edgeColorLoc = -1;
+
+    void Load();
+
+    static constexpr int GRADIENT_STEPS = 50;  // Number of colour bands
+};
@@ -1,129 +1,155 @@
 #include "ball.h"
+#include "entity_store.h"
 #include "game.h"
-#include "FakeLight.h"
+#include "ball_renderer.h"
+#include "random.h"
+#include "snapshot.h"
 #include <raylib.h>
-#include <raymath.h>
 
-Ball::Ball(Game* game, bool autoBounce)
-    : IPhysicsBody(game)
-    , radius(15)
-    , color(WHITE)
-    , isPlayer(!autoBounce)
-{
-    // Create Box2D body (convert pixels to meters)
-    b2BodyDef bodyDef = b2DefaultBodyDef();
+// Body and circle shape of a ball, given in meters like Box2D
+static b2BodyId CreateBallBody(b2WorldId worldId, int index, const b2BodyDef& base, float radius, float restitution) {
+    b2BodyDef bodyDef = base;
     bodyDef.type = b2_dynamicBody;
-    bodyDef.position = {100.0f / Game::PIXELS_PER_METER, 100.0f / Game::PIXELS_PER_METER};
     bodyDef.linearDamping = 0.5f;  // Add some friction
-    bodyDef.isAwake = true;  // Ensure body starts awake
-    bodyId = b2CreateBody(game->GetWorldId(), &bodyDef);
+    bodyDef.userData = EncodeEntity(EntityKind::Ball, index);  // Receives move events
+    b2BodyId bodyId = b2CreateBody(worldId, &bodyDef);
     
     // Create circle shape (convert radius to meters)
-    b2Circle circle;
+    b2Circle circle{};
     circle.center = {0.0f, 0.0f};
     circle.radius = radius / Game::PIXELS_PER_METER;
     
-    // Create shape definition with random restitution (bounciness)
     b2ShapeDef shapeDef = b2DefaultShapeDef();
     shapeDef.density = 1.0f;
     shapeDef.isSensor = false;  // NOT a sensor - solid collision
     shapeDef.material.friction = 0.3f;
-    // Random restitution between 0.7 and 0.9
-    shapeDef.material.restitution = 0.7f + (float)(GetRandomValue(0, 20)) / 100.0f;
+    shapeDef.material.restitution = restitution;
+    shapeDef.userData = EncodeEntity(EntityKind::Ball, index);  // Found by broadphase queries
     b2CreateCircleShape(bodyId, &shapeDef, &circle);
     
-    // If auto-bounce (enemy), give initial velocity
-    if (autoBounce) {
-        float vx = (float)(GetRandomValue(-50, 50));
-        float vy = (float)(GetRandomValue(-50, 50));
-        b2Body_SetLinearVelocity(bodyId, {vx, vy});
-    }
+    return bodyId;
+}
+
+// Body definition carrying a snapshot record's motion
+static b2BodyDef MakeBallBodyDef(const BallState& state) {
+    b2BodyDef bodyDef = b2DefaultBodyDef();
+    bodyDef.position = state.position;
+    bodyDef.rotation = state.rotation;
+    bodyDef.linearVelocity = state.linearVelocity;
+    bodyDef.angularVelocity = state.angularVelocity;
+    bodyDef.isAwake = state.awake != 0;
+    return bodyDef;
 }
 
-Ball::Ball(Game* game, float x, float y, Color color, bool autoBounce)
-    : IPhysicsBody(game)
-    , radius(15)
-    , color(color)
-    , isPlayer(!autoBounce)
-{
+int BallStore::Create(b2WorldId worldId, Random& random, float x, float y, Color color, bool autoBounce) {
+    int index = Count();
+    
     // Create Box2D body (convert pixels to meters)
     b2BodyDef bodyDef = b2DefaultBodyDef();
-    bodyDef.type = b2_dynamicBody;
     bodyDef.position = {x / Game::PIXELS_PER_METER, y / Game::PIXELS_PER_METER};
-    bodyDef.linearDamping = 0.5f;
     bodyDef.isAwake = true;  // Ensure body starts awake
-    bodyId = b2CreateBody(game->GetWorldId(), &bodyDef);
     
-    // Create circle shape (convert radius to meters)
-    b2Circle circle{};
-    circle.center = {0.0f, 0.0f};
-    circle.radius = radius / Game::PIXELS_PER_METER;
+    // Random restitution (bounciness) between 0.7 and 0.9
+    float restitution = 0.7f + (float)(random.Range(0, 20)) / 100.0f;
+    b2BodyId bodyId = CreateBallBody(worldId, index, bodyDef, RADIUS, restitution);
     
-    // Create shape definition with random restitution
-    b2ShapeDef shapeDef = b2DefaultShapeDef();
-    shapeDef.density = 1.0f;
-    shapeDef.isSensor = false;  // NOT a sensor - solid collision
-    shapeDef.material.friction = 0.3f;
-    // Random restitution between 0.7 and 0.9
-    shapeDef.material.restitution = 0.7f + (float)(GetRandomValue(0, 20)) / 100.0f;
-    b2CreateCircleShape(bodyId, &shapeDef, &circle);
+    // If auto-bounce (enemy), give initial velocity
     if (autoBounce) {
-        float vx = (float)(GetRandomValue(-50, 50));
-        float vy = (float)(GetRandomValue(-50, 50));
+        float vx = (float)(random.Range(-50, 50));
+        float vy = (float)(random.Range(-50, 50));
         b2Body_SetLinearVelocity(bodyId, {vx, vy});
     }
+    
+    bodyIds.push_back(bodyId);
+    radii.push_back(RADIUS);
+    colors.push_back(color);
+    flags.push_back(autoBounce ? 0 : FLAG_PLAYER);
+    transforms.Add(b2Body_GetTransform(bodyId));
+    
+    return index;
 }
 
-void Ball::Update() {
-    // Nothing to do - physics is handled by Box2D
-    // Position is automatically updated by the physics engine
+int BallStore::Restore(b2WorldId worldId, const BallState& state) {
+    int index = Count();
+    
+    // Motion goes straight into the body definition, no setters after creation
+    b2BodyId bodyId = CreateBallBody(worldId, index, MakeBallBodyDef(state), state.radius, state.restitution);
+    
+    bodyIds.push_back(bodyId);
+    radii.push_back(state.radius);
+    colors.push_back(state.color);
+    flags.push_back(state.flags);
+    transforms.Add(b2Body_GetTransform(bodyId));
+    
+    return index;
 }
 
-void Ball::Render() const {
-    // Get position from Box2D body (convert meters to pixels)
-    b2Vec2 pos = b2Body_GetPosition(bodyId);
-    Vector2 position = { pos.x * Game::PIXELS_PER_METER, pos.y * Game::PIXELS_PER_METER };
-    
-    // Get light intensity at this position
-    FakeLight* light = game->GetLight();
-    float intensity = light ? light->GetIntensityAt(position) : 1.0f;
-    
-    // Apply intensity to base color (darker when further from light)
-    Color litColor = ColorBrightness(color, (intensity - 1.0f) * 0.5f);
-    Color edgeColor = ColorBrightness(litColor, -0.3f);  // Darker at edges
-    
-    // Calculate highlight offset based on light direction  
-    Vector2 gradientCenter = position;
-    if (light) {
-        Vector2 highlightOffset = light->GetHighlightOffset(position, radius);
-        // Invert the offset so bright spot faces the light
-        gradientCenter.x = position.x - highlightOffset.x;
-        gradientCenter.y = position.y - highlightOffset.y;
-    }
+void BallStore::WriteState(int index, BallState& state) const {
+    b2BodyId bodyId = bodyIds[index];
+    b2ShapeId shapeId;
+    b2Body_GetShapes(bodyId, &shapeId, 1);
     
-    // Draw smooth gradient from bright center to darker edge
-    Color centerColor = ColorBrightness(litColor, 0.4f);  // Brighter at highlight
-    DrawCircleGradient(
-        (int)gradientCenter.x,
-        (int)gradientCenter.y,
-        radius,
-        centerColor,
-        edgeColor
-    );
-    
-    // Add subtle specular highlight for extra shine
-    if (light) {
-        Vector2 highlightOffset = light->GetHighlightOffset(position, radius);
-        Vector2 specularPos = {
-            position.x + highlightOffset.x * 0.6f,
-            position.y + highlightOffset.y * 0.6f
-        };
-        float specularRadius = radius * 0.2f;
-        DrawCircleV(specularPos, specularRadius, ColorAlpha(WHITE, 0.4f));
-    }
+    state = BallState{};
+    b2Transform transform = b2Body_GetTransform(bodyId);
+    state.position = transform.p;
+    state.rotation = transform.q;
+    state.linearVelocity = b2Body_GetLinearVelocity(bodyId);
+    state.angularVelocity = b2Body_GetAngularVelocity(bodyId);
+    state.restitution = b2Shape_GetRestitution(shapeId);
+    state.radius = radii[index];
+    state.color = colors[index];
+    state.flags = flags[index];
+    state.awake = b2Body_IsAwake(bodyId) ? 1 : 0;
+}
+
+void BallStore::MoveToWorld(int index, b2WorldId worldId) {
+    BallState state;
+    WriteState(index, state);
+    b2DestroyBody(bodyIds[index]);
+    bodyIds[index] = CreateBallBody(worldId, index, MakeBallBodyDef(state), state.radius, state.restitution);
+}
+
+b2BodyId BallStore::CreateGhost(int index, b2WorldId worldId) const {
+    b2BodyDef bodyDef = b2DefaultBodyDef();
+    bodyDef.type = b2_kinematicBody;
+    bodyDef.position = b2Body_GetPosition(bodyIds[index]);
+    b2BodyId bodyId = b2CreateBody(worldId, &bodyDef);  // Null user data, its move events decode to no entity
+    
+    b2Circle circle{};
+    circle.radius = radii[index] / Game::PIXELS_PER_METER;
+    
+    b2ShapeDef shapeDef = b2DefaultShapeDef();
+    shapeDef.material.friction = 0.3f;
+    shapeDef.userData = EncodeEntity(EntityKind::Ghost, -1);  // Skipped by broadphase queries
+    b2CreateCircleShape(bodyId, &shapeDef, &circle);
+    
+    return bodyId;
 }
 
-void Ball::ApplyForce(float x, float y) {
+void BallStore::Reserve(int count) {
+    bodyIds.reserve(count);
+    radii.reserve(count);
+    colors.reserve(count);
+    flags.reserve(count);
+    transforms.Reserve(count);
+}
+
+void BallStore::ApplyForce(int index, float x, float y) {
     b2Vec2 force = {x * MOVE_FORCE, y * MOVE_FORCE};
-    b2Body_ApplyForceToCenter(bodyId, force, true);
+    b2Body_ApplyForceToCenter(bodyIds[index], force, true);
+}
+
+void BallStore::AppendTo(BallInstances& balls, const TrackedVector<int, MemorySystem::Render>& indices, bool players,
+                         float alpha, uint64_t latestStep) const {
+    uint8_t wanted = players ? FLAG_PLAYER : 0;
+    
+    for (int i : indices) {
+        if ((flags[i] & FLAG_PLAYER) != wanted) continue;
+        
+        // Position interpolated between physics steps (convert meters to pixels)
+        // Lighting is added afterwards by a LightField, shading happens on the GPU
+        b2Vec2 pos = transforms.Interpolated(i, alpha, latestStep).p;
+        Vector2 position = { pos.x * Game::PIXELS_PER_METER, pos.y * Game::PIXELS_PER_METER };
+        balls.Add(position, radii[i], colors[i]);
+    }
 }
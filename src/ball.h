@@ -1,25 +1,67 @@
 #pragma once
 #include <raylib.h>
 #include <box2d/box2d.h>
-#include "IPhysicsBody.h"
-#include "IRenderable.h"
+#include <cstdint>
+#include <vector>
+#include "transform_history.h"
+#include "memory.h"
 
-class Game;
+class BallInstances;
+class Random;
+struct BallState;
 
-class Ball : public IPhysicsBody, public IRenderable {
+// Structure-of-arrays storage for every ball in the game
+// Update and render walk these arrays directly instead of chasing pointers
+// to individually allocated objects through virtual calls
+class BallStore {
 public:
-    Ball(Game* game, bool autoBounce = true);
-    Ball(Game* game, float x, float y, Color color, bool autoBounce = true);
-    ~Ball() override = default;
+    // Create a ball body at (x, y) in pixels and return its index
+    // Auto-bouncing balls (enemies) start with a random velocity,
+    // the others are player-controlled
+    // Restitution and velocity are drawn from random so worlds rebuild identically
+    int Create(b2WorldId worldId, Random& random, float x, float y, Color color, bool autoBounce = true);
+    
+    // Recreate a ball from a snapshot and return its index
+    int Restore(b2WorldId worldId, const BallState& state);
+    
+    // Fill a snapshot record with the ball's current body state
+    void WriteState(int index, BallState& state) const;
+    
+    // Recreate the ball's body with its current motion in another world,
+    // for a ball crossing into another shard
+    void MoveToWorld(int index, b2WorldId worldId);
+    
+    // Kinematic copy of the ball in another world, mirrored by ShardedWorld
+    b2BodyId CreateGhost(int index, b2WorldId worldId) const;
+    
+    int Count() const { return (int)bodyIds.size(); }
+    void Reserve(int count);
+    b2BodyId GetBodyId(int index) const { return bodyIds[index]; }
+    float GetRadius(int index) const { return radii[index]; }
+    Color GetColor(int index) const { return colors[index]; }
+    bool IsPlayer(int index) const { return (flags[index] & FLAG_PLAYER) != 0; }
+    const b2Transform& GetTransform(int index) const { return transforms.Current(index); }
+    bool MovedIn(int index, uint64_t step) const { return transforms.MovedIn(index, step); }
+    
+    void ApplyForce(int index, float x, float y);
+    void SyncTransform(int index, const b2Transform& transform, uint64_t step) {
+        transforms.Sync(index, transform, step);
+    }
+    
+    // Queue either the player balls or the other balls among indices for
+    // drawing, interpolated between the last two physics steps
+    void AppendTo(BallInstances& balls, const TrackedVector<int, MemorySystem::Render>& indices, bool players,
+                  float alpha, uint64_t latestStep) const;
 
-    void Update() override;
-    void Render() const override;
-    void ApplyForce(float x, float y);
+    static constexpr uint8_t FLAG_PLAYER = 1 << 0;
 
 private:
-    float radius;
-    Color color;
-    bool isPlayer;
+    TrackedVector<b2BodyId, MemorySystem::Entities> bodyIds;
+    TrackedVector<float, MemorySystem::Entities> radii;
+    TrackedVector<Color, MemorySystem::Entities> colors;
+    TrackedVector<uint8_t, MemorySystem::Entities> flags;
+    TransformHistory transforms;
 
+    static constexpr float RADIUS = 15.0f;
     static constexpr float MOVE_FORCE = 50.0f;
 };
@@ -0,0 +1,230 @@
+#include "ball_renderer.h"
+#include "light_field.h"
+#include "lightmap.h"
+#include <raymath.h>
+#include <rlgl.h>
+#include <cstddef>
+
+// Attribute slots of the instanced ball shader
+static constexpr int CORNER_ATTRIB = 0;
+static constexpr int CENTER_RADIUS_ATTRIB = 1;
+static constexpr int COLOR_ATTRIB = 2;
+static constexpr int LIGHTING_ATTRIB = 3;
+
+// Expands each instance into a quad around the shaded disc and turns its
+// lighting into colours once, so the fragment shader only shades
+static const char* BALL_VERTEX_SHADER = R"(
+#version 330
+
+layout(location = 0) in vec2 corner;
+layout(location = 1) in vec3 centerRadius;
+layout(location = 2) in vec4 color;
+layout(location = 3) in vec3 lighting;
+
+uniform mat4 mvp;
+
+out vec2 localPos;
+flat out float radius;
+flat out vec2 highlightOffset;
+flat out vec3 centerColor;
+flat out vec3 edgeColor;
+
+// Same as raylib's ColorBrightness
+vec3 brightness(vec3 c, float factor)
+{
+    return factor < 0.0 ? c * (1.0 + factor) : c + (1.0 - c) * factor;
+}
+
+void main()
+{
+    vec2 position = centerRadius.xy;
+    radius = centerRadius.z;
+    
+    // Direction towards the light and falloff, from the LightField
+    float intensity = lighting.z;
+    highlightOffset = lighting.xy * radius * 0.4;
+    
+    vec3 litColor = brightness(color.rgb, (intensity - 1.0) * 0.5);
+    centerColor = brightness(litColor, 0.4);
+    edgeColor = brightness(litColor, -0.3);
+    
+    // The shaded disc is centred away from the light, and the quad covers it
+    vec2 discCenter = position - highlightOffset;
+    localPos = corner * radius;
+    gl_Position = mvp * vec4(discCenter + localPos, 0.0, 1.0);
+}
+)";
+
+static const char* BALL_FRAGMENT_SHADER = R"(
+#version 330
+
+in vec2 localPos;
+flat in float radius;
+flat in vec2 highlightOffset;
+flat in vec3 centerColor;
+flat in vec3 edgeColor;
+
+out vec4 finalColor;
+
+void main()
+{
+    float d = length(localPos);
+    float aa = fwidth(d);
+    float coverage = 1.0 - smoothstep(radius - aa, radius, d);
+    if (coverage <= 0.0) discard;
+    
+    // Gradient from the bright centre to the darker edge
+    vec3 color = mix(centerColor, edgeColor, clamp(d / radius, 0.0, 1.0));
+    
+    // Specular spot towards the light, measured from the disc centre
+    vec2 specularCenter = highlightOffset * 1.6;
+    float specularRadius = radius * 0.2;
+    float ds = distance(localPos, specularCenter);
+    float specular = (1.0 - smoothstep(specularRadius - aa, specularRadius, ds)) * 0.4;
+    color = mix(color, vec3(1.0), specular);
+    
+    finalColor = vec4(color, coverage);
+}
+)";
+
+BallRenderer::~BallRenderer() {
+    if (!loaded) return;
+    
+    if (instanceBuffer) rlUnloadVertexBuffer(instanceBuffer);
+    if (cornerBuffer) rlUnloadVertexBuffer(cornerBuffer);
+    if (vertexArray) rlUnloadVertexArray(vertexArray);
+    UnloadShader(shader);
+}
+
+void BallInstances::Clear() {
+    instances.clear();
+}
+
+void BallInstances::Add(Vector2 position, float radius, Color color) {
+    instances.push_back(Instance{ position.x, position.y, radius, color, 0.0f, 0.0f, 1.0f });
+}
+
+void BallInstances::Light(LightField& lights) {
+    if (instances.empty() || !lights.HasLights()) return;
+    
+    // Pack the positions so the field can shade them several at a time
+    PackPositions();
+    lights.Evaluate(positionX.data(), positionY.data(), (int)instances.size(),
+                    intensities.data(), directionX.data(), directionY.data());
+    UnpackLighting();
+}
+
+void BallInstances::Light(const Lightmap& lightmap) {
+    if (instances.empty() || !lightmap.HasLights()) return;
+    
+    PackPositions();
+    lightmap.Evaluate(positionX.data(), positionY.data(), (int)instances.size(),
+                      intensities.data(), directionX.data(), directionY.data());
+    UnpackLighting();
+}
+
+void BallInstances::PackPositions() {
+    int count = (int)instances.size();
+    positionX.resize(count);
+    positionY.resize(count);
+    intensities.resize(count);
+    directionX.resize(count);
+    directionY.resize(count);
+    for (int i = 0; i < count; i++) {
+        positionX[i] = instances[i].x;
+        positionY[i] = instances[i].y;
+    }
+}
+
+void BallInstances::UnpackLighting() {
+    for (size_t i = 0; i < instances.size(); i++) {
+        instances[i].lightX = directionX[i];
+        instances[i].lightY = directionY[i];
+        instances[i].intensity = intensities[i];
+    }
+}
+
+void BallRenderer::Load() {
+    loaded = true;
+    
+    shader = LoadShaderFromMemory(BALL_VERTEX_SHADER, BALL_FRAGMENT_SHADER);
+    if (!IsShaderValid(shader)) return;
+    
+    mvpLoc = GetShaderLocation(shader, "mvp");
+    
+    // Two triangles spanning the unit square, shared by every instance
+    const float corners[12] = {
+        -1.0f, -1.0f,   -1.0f, 1.0f,   1.0f, 1.0f,
+        -1.0f, -1.0f,    1.0f, 1.0f,   1.0f, -1.0f
+    };
+    
+    vertexArray = rlLoadVertexArray();
+    rlEnableVertexArray(vertexArray);
+    cornerBuffer = rlLoadVertexBuffer(corners, sizeof(corners), false);
+    rlSetVertexAttribute(CORNER_ATTRIB, 2, RL_FLOAT, false, 0, 0);
+    rlEnableVertexAttribute(CORNER_ATTRIB);
+    rlDisableVertexArray();
+    
+    ReserveInstances(MIN_CAPACITY);
+}
+
+void BallRenderer::ReserveInstances(int count) {
+    if (count <= instanceCapacity) return;
+    
+    // Grow geometrically so a rising ball count only reallocates occasionally
+    int capacity = instanceCapacity > 0 ? instanceCapacity : MIN_CAPACITY;
+    while (capacity < count) capacity *= 2;
+    
+    rlEnableVertexArray(vertexArray);
+    if (instanceBuffer) rlUnloadVertexBuffer(instanceBuffer);
+    instanceBuffer = rlLoadVertexBuffer(nullptr, capacity * (int)sizeof(Instance), true);
+    
+    rlSetVertexAttribute(CENTER_RADIUS_ATTRIB, 3, RL_FLOAT, false, sizeof(Instance), offsetof(Instance, x));
+    rlSetVertexAttributeDivisor(CENTER_RADIUS_ATTRIB, 1);
+    rlEnableVertexAttribute(CENTER_RADIUS_ATTRIB);
+    
+    rlSetVertexAttribute(COLOR_ATTRIB, 4, RL_UNSIGNED_BYTE, true, sizeof(Instance), offsetof(Instance, color));
+    rlSetVertexAttributeDivisor(COLOR_ATTRIB, 1);
+    rlEnableVertexAttribute(COLOR_ATTRIB);
+    
+    rlSetVertexAttribute(LIGHTING_ATTRIB, 3, RL_FLOAT, false, sizeof(Instance), offsetof(Instance, lightX));
+    rlSetVertexAttributeDivisor(LIGHTING_ATTRIB, 1);
+    rlEnableVertexAttribute(LIGHTING_ATTRIB);
+    rlDisableVertexArray();
+    
+    instanceCapacity = capacity;
+}
+
+void BallRenderer::Draw(const BallInstances& balls) {
+    const TrackedVector<Instance, MemorySystem::Render>& instances = balls.Instances();
+    if (instances.empty()) return;
+    
+    if (!loaded) Load();
+    if (!IsShaderValid(shader)) {
+        DrawFallback(balls);
+        return;
+    }
+    
+    // Anything raylib has batched so far must reach the screen before the balls
+    rlDrawRenderBatchActive();
+    
+    int count = (int)instances.size();
+    ReserveInstances(count);
+    rlUpdateVertexBuffer(instanceBuffer, instances.data(), count * (int)sizeof(Instance), 0);
+    
+    rlEnableShader(shader.id);
+    rlSetUniformMatrix(mvpLoc, MatrixMultiply(rlGetMatrixModelview(), rlGetMatrixProjection()));
+    
+    rlEnableVertexArray(vertexArray);
+    rlDrawVertexArrayInstanced(0, 6, count);
+    rlDisableVertexArray();
+    rlDisableShader();
+}
+
+void BallRenderer::DrawFallback(const BallInstances& balls) const {
+    // Without shader support, draw flat discs dimmed by the light falloff
+    for (const Instance& instance : balls.Instances()) {
+        Vector2 position = { instance.x, instance.y };
+        DrawCircleV(position, instance.radius, ColorBrightness(instance.color, (instance.intensity - 1.0f) * 0.5f));
+    }
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <raylib.h>
+#include <vector>
+#include "memory.h"
+
+class LightField;
+class Lightmap;
+
+// Balls queued for one instanced draw, with their lighting
+// Filled without touching the GPU, so a frame can be prepared on another
+// thread than the one drawing it
+class BallInstances {
+public:
+    // Per-instance vertex data, laid out as the shader's attributes expect
+    struct Instance {
+        float x, y;
+        float radius;
+        Color color;
+        float lightX, lightY;  // Unit direction towards the light, zero when unlit
+        float intensity;
+    };
+    
+    // Drop the instances of the previous frame, keeping capacity
+    void Clear();
+    
+    // Queue a ball centred on position (pixels), unlit until Light is called
+    void Add(Vector2 position, float radius, Color color);
+    
+    // Light every queued ball by all the lights of the field at once
+    void Light(LightField& lights);
+    
+    // Light every queued ball from a lightmap, with the shadows of its walls
+    void Light(const Lightmap& lightmap);
+    
+    int Count() const { return (int)instances.size(); }
+    const TrackedVector<Instance, MemorySystem::Render>& Instances() const { return instances; }
+
+private:
+    TrackedVector<Instance, MemorySystem::Render> instances;
+    
+    // Packed positions and lighting results handed to the light field
+    TrackedVector<float, MemorySystem::Render> positionX;
+    TrackedVector<float, MemorySystem::Render> positionY;
+    TrackedVector<float, MemorySystem::Render> intensities;
+    TrackedVector<float, MemorySystem::Render> directionX;
+    TrackedVector<float, MemorySystem::Render> directionY;
+    
+    // Copy the positions into the packed arrays, and the results back
+    void PackPositions();
+    void UnpackLighting();
+};
+
+// Draws any number of lit balls with one instanced draw call
+// Each ball uploads a compact 28-byte record with its lighting, worked out
+// on the CPU by a LightField; the shading gradient and the specular
+// highlight are evaluated on the GPU
+class BallRenderer {
+public:
+    BallRenderer() = default;
+    ~BallRenderer();
+
+    BallRenderer(const BallRenderer&) = delete;
+    BallRenderer& operator=(const BallRenderer&) = delete;
+    
+    // Draw all the given balls
+    void Draw(const BallInstances& balls);
+
+private:
+    using Instance = BallInstances::Instance;
+    
+    // GPU objects, created on first draw once a GL context exists
+    bool loaded = false;
+    Shader shader = {};
+    unsigned int vertexArray = 0;
+    unsigned int cornerBuffer = 0;
+    unsigned int instanceBuffer = 0;
+    int instanceCapacity = 0;
+    
+    int mvpLoc = -1;
+
+    void Load();
+    void ReserveInstances(int count);
+    void DrawFallback(const BallInstances& balls) const;
+    
+    static constexpr int MIN_CAPACITY = 256;
+};
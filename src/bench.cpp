@@ -0,0 +1,347 @@
+// bench.cpp : Microbenchmarks of the game's hot kernels, printed as JSON
+//
+// Every kernel runs a fixed amount of work per sample on inputs drawn from a
+// fixed seed, after one untimed warm-up sample, so two runs of the same build
+// on the same machine differ only by noise and their output can be diffed
+#include "FakeLight.h"
+#include "light_field.h"
+#include "lightmap.h"
+#include "brick.h"
+#include "brick_batch.h"
+#include "wall.h"
+#include "game.h"
+#include "scene.h"
+#include "random.h"
+#include "stats.h"
+#include <box2d/box2d.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+using BenchClock = std::chrono::steady_clock;
+using BenchParams = std::vector<std::pair<const char*, int>>;
+
+static constexpr unsigned int BENCH_SEED = 1;
+static constexpr float AREA_WIDTH = 800.0f;   // Pixels, the default arena
+static constexpr float AREA_HEIGHT = 600.0f;
+
+// Results are folded in here so the compiler cannot drop the kernels
+static volatile float benchSink = 0.0f;
+
+// Timing of one kernel with one set of parameters
+struct BenchResult {
+    std::string name;
+    BenchParams params;
+    int ops = 0;                // Items processed per sample
+    SampleSummary nsPerOp;
+};
+
+class BenchRunner {
+public:
+    BenchRunner(int samples, const char* filter)
+        : samples(samples), filter(filter)
+    {
+    }
+
+    // Whether the filter selects a benchmark, for skipping expensive preparation
+    bool Wants(const char* name) const {
+        return !filter || strstr(name, filter) != nullptr;
+    }
+
+    // Time body, which processes ops items, once per sample
+    // setup runs untimed before every sample, including the warm-up
+    void Run(const char* name, const BenchParams& params, int ops,
+             const std::function<void()>& setup, const std::function<void()>& body) {
+        if (!Wants(name)) return;
+
+        std::vector<double> nsPerOp;
+        nsPerOp.reserve(samples);
+        for (int sample = -1; sample < samples; sample++) {
+            setup();
+            BenchClock::time_point start = BenchClock::now();
+            body();
+            BenchClock::time_point end = BenchClock::now();
+            if (sample < 0) continue;
+
+            double ns = std::chrono::duration<double, std::nano>(end - start).count();
+            nsPerOp.push_back(ns / ops);
+        }
+
+        BenchResult result;
+        result.name = name;
+        result.params = params;
+        result.ops = ops;
+        result.nsPerOp = Summarize(std::move(nsPerOp));
+        results.push_back(std::move(result));
+    }
+
+    void Print() const {
+        printf("{\n");
+        printf("  \"mode\": \"bench\",\n");
+        printf("  \"seed\": %u,\n", BENCH_SEED);
+        printf("  \"samples\": %d,\n", samples);
+        printf("  \"benchmarks\": [\n");
+        for (size_t i = 0; i < results.size(); i++) {
+            const BenchResult& result = results[i];
+            printf("    {\"name\": \"%s\", \"params\": {", result.name.c_str());
+            for (size_t p = 0; p < result.params.size(); p++) {
+                printf("%s\"%s\": %d", p > 0 ? ", " : "", result.params[p].first, result.params[p].second);
+            }
+            const SampleSummary& ns = result.nsPerOp;
+            printf("}, \"ops\": %d, \"nsPerOp\": {\"mean\": %.3f, \"p50\": %.3f, \"p99\": %.3f, \"min\": %.3f, \"max\": %.3f}}%s\n",
+                result.ops, ns.mean, ns.p50, ns.p99, ns.min, ns.max,
+                i + 1 < results.size() ? "," : "");
+        }
+        printf("  ]\n");
+        printf("}\n");
+    }
+
+private:
+    int samples;
+    const char* filter;  // Substring of the benchmark names to run, all when nullptr
+    std::vector<BenchResult> results;
+};
+
+static float RandomFloat(Random& random, float min, float max) {
+    return min + (max - min) * (float)random.Next() / 4294967295.0f;
+}
+
+static std::vector<Vector2> RandomPoints(Random& random, int count) {
+    std::vector<Vector2> points(count);
+    for (Vector2& point : points) {
+        point = { RandomFloat(random, 0.0f, AREA_WIDTH), RandomFloat(random, 0.0f, AREA_HEIGHT) };
+    }
+    return points;
+}
+
+// FakeLight::GetIntensityAt and GetHighlightOffset, one ball at a time
+static void BenchFakeLight(BenchRunner& runner) {
+    const int count = 4096;
+    Random random(BENCH_SEED);
+    std::vector<Vector2> points = RandomPoints(random, count);
+    FakeLight light({ AREA_WIDTH / 2.0f, AREA_HEIGHT / 2.0f }, LightType::Point);
+
+    runner.Run("fake_light.intensity", { { "points", count } }, count, [] {}, [&] {
+        float sum = 0.0f;
+        for (const Vector2& point : points) {
+            sum += light.GetIntensityAt(point);
+        }
+        benchSink = sum;
+    });
+
+    runner.Run("fake_light.highlight_offset", { { "points", count } }, count, [] {}, [&] {
+        float sum = 0.0f;
+        for (const Vector2& point : points) {
+            Vector2 offset = light.GetHighlightOffset(point, 15.0f);
+            sum += offset.x + offset.y;
+        }
+        benchSink = sum;
+    });
+}
+
+// LightField::Evaluate, every visible ball lit by every light in one pass
+static void BenchLightField(BenchRunner& runner) {
+    const int count = 10000;
+    if (!runner.Wants("light_field.evaluate")) return;
+
+    for (int lightCount : { 1, 16, 100 }) {
+        Random random(BENCH_SEED);
+        std::vector<FakeLight> lights;
+        for (int i = 0; i < lightCount; i++) {
+            lights.emplace_back(RandomPoints(random, 1).front(), LightType::Point);
+        }
+
+        std::vector<Vector2> points = RandomPoints(random, count);
+        std::vector<float> xs(count), ys(count), intensity(count), dirX(count), dirY(count);
+        for (int i = 0; i < count; i++) {
+            xs[i] = points[i].x;
+            ys[i] = points[i].y;
+        }
+
+        LightField field;
+        field.Build(lights, AREA_WIDTH, AREA_HEIGHT);
+        runner.Run("light_field.evaluate", { { "lights", lightCount }, { "points", count } }, count, [] {}, [&] {
+            field.Evaluate(xs.data(), ys.data(), count, intensity.data(), dirX.data(), dirY.data());
+            benchSink = intensity[count / 2];
+        });
+    }
+}
+
+// Lightmap::Evaluate behind four walls, and the update after one brick
+// leaves a wall and lets the lights into its shadow
+// Each update sample starts from a fully built map, the build is not timed
+static void BenchLightmap(BenchRunner& runner) {
+    const int count = 10000;
+    if (!runner.Wants("lightmap")) return;
+
+    for (int lightCount : { 1, 16 }) {
+        Random random(BENCH_SEED);
+        std::vector<FakeLight> lights;
+        for (int i = 0; i < lightCount; i++) {
+            lights.emplace_back(RandomPoints(random, 1).front(), LightType::Point);
+        }
+
+        std::vector<Vector2> points = RandomPoints(random, count);
+        std::vector<float> xs(count), ys(count), intensity(count), dirX(count), dirY(count);
+        for (int i = 0; i < count; i++) {
+            xs[i] = points[i].x;
+            ys[i] = points[i].y;
+        }
+
+        b2WorldDef worldDef = b2DefaultWorldDef();
+        worldDef.gravity = { 0.0f, 0.0f };
+        b2WorldId worldId = b2CreateWorld(&worldDef);
+        BrickStore bricks;
+        for (int row = 0; row < 4; row++) {
+            Wall wall(bricks, worldId, 100.0f, 120.0f + row * 120.0f, 40, true, RED);
+        }
+
+        Lightmap lightmap;
+        lightmap.Reset(AREA_WIDTH, AREA_HEIGHT, bricks);
+        lightmap.Update(lights);
+        runner.Run("lightmap.evaluate", { { "lights", lightCount }, { "points", count } }, count, [] {}, [&] {
+            lightmap.Evaluate(xs.data(), ys.data(), count, intensity.data(), dirX.data(), dirY.data());
+            benchSink = intensity[count / 2];
+        });
+
+        // Bricks taken in turn along the walls, so samples see different shadows
+        int brick = 0;
+        auto setup = [&] {
+            lightmap.Reset(AREA_WIDTH, AREA_HEIGHT, bricks);
+            lightmap.Update(lights);
+        };
+        runner.Run("lightmap.remove_occluder", { { "lights", lightCount }, { "cells", lightmap.CellCount() } }, 1, setup, [&] {
+            lightmap.RemoveOccluder(bricks.GetTransform(brick));
+            lightmap.Update(lights);
+            brick = (brick + 37) % bricks.Count();
+            benchSink = (float)lightmap.LastUpdatedCells();
+        });
+
+        b2DestroyWorld(worldId);
+    }
+}
+
+// The corner transform of every brick quad, fill and border, into the batch
+static void BenchBrickBatch(BenchRunner& runner) {
+    for (int count : { 1000, 10000 }) {
+        Random random(BENCH_SEED);
+        std::vector<Vector2> positions = RandomPoints(random, count);
+        std::vector<b2Rot> rotations(count);
+        for (b2Rot& rotation : rotations) {
+            rotation = b2MakeRot(RandomFloat(random, -B2_PI, B2_PI));
+        }
+
+        BrickBatch batch;
+        runner.Run("brick_batch.add_brick", { { "bricks", count } }, count, [] {}, [&] {
+            batch.Clear();
+            for (int i = 0; i < count; i++) {
+                batch.AddBrick(positions[i], rotations[i], 7.5f, 7.5f, 1.0f, RED, MAROON);
+            }
+            benchSink = (float)batch.QuadCount();
+        });
+    }
+}
+
+// BrickStore::Break splitting hit bricks off walls of different lengths
+// Each sample breaks bricks of a freshly built wall, the build is not timed
+static void BenchBreaks(BenchRunner& runner) {
+    if (!runner.Wants("bricks.break")) return;
+
+    for (int brickCount : { 16, 128, 1024 }) {
+        for (int hitCount : { 1, 16 }) {
+            b2WorldId worldId = b2_nullWorldId;
+            std::unique_ptr<BrickStore> bricks;
+
+            auto setup = [&] {
+                if (B2_IS_NON_NULL(worldId)) b2DestroyWorld(worldId);
+                b2WorldDef worldDef = b2DefaultWorldDef();
+                worldDef.gravity = { 0.0f, 0.0f };
+                worldId = b2CreateWorld(&worldDef);
+                bricks = std::make_unique<BrickStore>();
+                bricks->Reserve(brickCount);
+                Wall wall(*bricks, worldId, 100.0f, 100.0f, brickCount, true, RED);
+            };
+
+            // Hits spread evenly along the wall
+            int stride = brickCount / hitCount;
+            runner.Run("bricks.break", { { "bricks", brickCount }, { "hits", hitCount } }, hitCount, setup, [&] {
+                for (int hit = 0; hit < hitCount; hit++) {
+                    bricks->Break(hit * stride, { 2.0f, 1.0f });
+                }
+            });
+
+            b2DestroyWorld(worldId);
+        }
+    }
+}
+
+// b2World_Step on the ball swarm preset, after its opening collisions
+static void BenchStep(BenchRunner& runner) {
+    if (!runner.Wants("box2d.step")) return;
+
+    for (int bodyCount : { 1000, 4000, 10000 }) {
+        Random sceneRandom(BENCH_SEED);
+        Scene scene;
+        std::string error;
+        if (!ResolveScene("ball-swarm", bodyCount, sceneRandom, scene, error)) {
+            fprintf(stderr, "bench: %s\n", error.c_str());
+            continue;
+        }
+
+        GameConfig config;
+        config.seed = BENCH_SEED;
+        Game game(config, scene);
+        for (int i = 0; i < 60; i++) {
+            game.Update(game.FixedTimeStep());
+        }
+
+        b2WorldId worldId = game.GetWorldId();
+        float timeStep = game.FixedTimeStep();
+        runner.Run("box2d.step", { { "bodies", b2World_GetCounters(worldId).bodyCount } }, 1, [] {}, [&] {
+            b2World_Step(worldId, timeStep, 4);
+        });
+    }
+}
+
+static void PrintBenchUsage() {
+    printf("usage: raycode_bench [--samples N] [--filter TEXT]\n");
+}
+
+int main(int argc, char** argv) {
+    int samples = 15;
+    const char* filter = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (strcmp(arg, "--samples") == 0 && hasValue) {
+            samples = atoi(argv[++i]);
+        } else if (strcmp(arg, "--filter") == 0 && hasValue) {
+            filter = argv[++i];
+        } else {
+            PrintBenchUsage();
+            return 1;
+        }
+    }
+    if (samples <= 0) {
+        PrintBenchUsage();
+        return 1;
+    }
+
+    BenchRunner runner(samples, filter);
+    BenchFakeLight(runner);
+    BenchLightField(runner);
+    BenchLightmap(runner);
+    BenchBrickBatch(runner);
+    BenchBreaks(runner);
+    BenchStep(runner);
+    runner.Print();
+    return 0;
+}
@@ -1,96 +1,304 @@
 #include "brick.h"
+#include "entity_store.h"
+#include "brick_batch.h"
 #include "game.h"
+#include "snapshot.h"
 #include <raylib.h>
 
-Brick::Brick(Game* game, float x, float y, Color color, bool attached)
-    : IPhysicsBody(game)
-    , color(color)
-    , attached(attached)
-{
-    // Create Box2D body (convert pixels to meters)
+// Shape of one brick centred on the given point of its body (meters)
+static b2Polygon MakeBrickBox(b2Vec2 center) {
+    // Convert dimensions to meters
+    return b2MakeOffsetBox(
+        BrickStore::BRICK_WIDTH / Game::PIXELS_PER_METER,
+        BrickStore::BRICK_HEIGHT / Game::PIXELS_PER_METER,
+        center,
+        b2Rot_identity
+    );
+}
+
+// Shape definition shared by attached and broken bricks
+// Only attached bricks need hit events, debris has nothing left to break
+static b2ShapeDef MakeBrickShapeDef(int index, bool attached) {
+    b2ShapeDef shapeDef = b2DefaultShapeDef();
+    shapeDef.density = 1.0f;
+    shapeDef.material.friction = 0.5f;
+    shapeDef.material.restitution = 0.3f;
+    shapeDef.enableHitEvents = attached;  // Enable hit events for breaking
+    shapeDef.userData = EncodeEntity(EntityKind::Brick, index);  // Lets hit events find their brick in O(1)
+    return shapeDef;
+}
+
+// Body definition of a brick moving on its own
+static b2BodyDef MakeBrickBodyDef(int index, b2BodyType type, b2Vec2 position, b2Rot rotation) {
     b2BodyDef bodyDef = b2DefaultBodyDef();
-    
-    if (attached) {
-        bodyDef.type = b2_staticBody;  // Static when attached
-    } else {
-        bodyDef.type = b2_dynamicBody;  // Dynamic when broken off
-    }
-    
-    bodyDef.position = {x / Game::PIXELS_PER_METER, y / Game::PIXELS_PER_METER};
+    bodyDef.type = type;
+    bodyDef.position = position;
+    bodyDef.rotation = rotation;
     bodyDef.linearDamping = 2.0f;   // High linear damping to slow down movement
     bodyDef.angularDamping = 3.0f;  // High angular damping to slow down rotation
     bodyDef.isAwake = true;
-    bodyId = b2CreateBody(game->GetWorldId(), &bodyDef);
+    bodyDef.userData = EncodeEntity(EntityKind::Brick, index);  // Receives move events
+    return bodyDef;
+}
+
+// Body of a brick moving or resting on its own, with a snapshot record's motion
+// Attached and frozen bricks are static, moving debris keeps its motion
+static b2BodyId CreateOwnBody(b2WorldId worldId, int index, const BrickState& state, b2ShapeId& shapeId) {
+    bool attached = (state.flags & BrickStore::FLAG_ATTACHED) != 0;
+    bool isStatic = attached || (state.flags & BrickStore::FLAG_FROZEN) != 0;
+    b2BodyDef bodyDef = MakeBrickBodyDef(index, isStatic ? b2_staticBody : b2_dynamicBody,
+                                         state.position, state.rotation);
+    bodyDef.linearVelocity = state.linearVelocity;
+    bodyDef.angularVelocity = state.angularVelocity;
+    bodyDef.isAwake = state.awake != 0;
+    b2BodyId bodyId = b2CreateBody(worldId, &bodyDef);
+    
+    b2Polygon box = MakeBrickBox({0.0f, 0.0f});
+    b2ShapeDef shapeDef = MakeBrickShapeDef(index, attached);
+    shapeId = b2CreatePolygonShape(bodyId, &shapeDef, &box);
+    return bodyId;
+}
+
+int BrickStore::Create(b2WorldId worldId, float x, float y, Color color, bool attached) {
+    int index = Count();
     
-    // Create box shape (convert dimensions to meters)
-    b2Polygon box = b2MakeBox(
-        BRICK_WIDTH / Game::PIXELS_PER_METER, 
-        BRICK_HEIGHT / Game::PIXELS_PER_METER
+    // Static when attached, dynamic when broken off (convert pixels to meters)
+    b2BodyDef bodyDef = MakeBrickBodyDef(
+        index,
+        attached ? b2_staticBody : b2_dynamicBody,
+        {x / Game::PIXELS_PER_METER, y / Game::PIXELS_PER_METER},
+        b2Rot_identity
     );
+    b2BodyId bodyId = b2CreateBody(worldId, &bodyDef);
     
-    // Create shape definition
-    b2ShapeDef shapeDef = b2DefaultShapeDef();
-    shapeDef.density = 1.0f;
-    shapeDef.material.friction = 0.5f;
-    shapeDef.material.restitution = 0.3f;
-    shapeDef.enableHitEvents = true;  // Enable hit events for breaking
-    shapeId = b2CreatePolygonShape(bodyId, &shapeDef, &box);
+    b2Polygon box = MakeBrickBox({0.0f, 0.0f});
+    b2ShapeDef shapeDef = MakeBrickShapeDef(index, attached);
+    b2ShapeId shapeId = b2CreatePolygonShape(bodyId, &shapeDef, &box);
+    
+    return Add(bodyId, shapeId, color, attached, b2Body_GetTransform(bodyId));
 }
 
-void Brick::Update() {
-    // Nothing to do - physics handled by Box2D
+int BrickStore::CreateInWall(b2BodyId wallBodyId, float x, float y, Color color) {
+    int index = Count();
+    
+    // Place the box relative to the wall body (convert pixels to meters)
+    b2Vec2 center = {x / Game::PIXELS_PER_METER, y / Game::PIXELS_PER_METER};
+    b2Vec2 wallPosition = b2Body_GetPosition(wallBodyId);
+    b2Vec2 localCenter = {center.x - wallPosition.x, center.y - wallPosition.y};
+    
+    b2Polygon box = MakeBrickBox(localCenter);
+    b2ShapeDef shapeDef = MakeBrickShapeDef(index, true);
+    b2ShapeId shapeId = b2CreatePolygonShape(wallBodyId, &shapeDef, &box);
+    
+    // Walls never move, so the brick's transform is fixed until it breaks
+    b2Transform transform = {center, b2Body_GetRotation(wallBodyId)};
+    return Add(wallBodyId, shapeId, color, true, transform);
 }
 
-void Brick::Render() const {
-    // Get position from Box2D body (convert meters to pixels)
-    b2Vec2 pos = b2Body_GetPosition(bodyId);
-    b2Rot rot = b2Body_GetRotation(bodyId);
+int BrickStore::Restore(b2WorldId worldId, b2BodyId wallBodyId, const BrickState& state) {
+    int index = Count();
+    b2Transform transform = {state.position, state.rotation};
+    bool attached = (state.flags & FLAG_ATTACHED) != 0;
     
-    float x = pos.x * Game::PIXELS_PER_METER;
-    float y = pos.y * Game::PIXELS_PER_METER;
-    float angle = b2Rot_GetAngle(rot) * RAD2DEG;
+    if (state.flags & FLAG_CULLED) {
+        // Culled debris has no body, its old one was pooled and is not part of the snapshot
+        Add(b2_nullBodyId, b2_nullShapeId, state.color, false, transform);
+    } else if (attached && B2_IS_NON_NULL(wallBodyId)) {
+        // Back onto the wall's shared body (convert meters to pixels)
+        CreateInWall(wallBodyId, state.position.x * Game::PIXELS_PER_METER,
+                     state.position.y * Game::PIXELS_PER_METER, state.color);
+    } else {
+        b2ShapeId shapeId;
+        b2BodyId bodyId = CreateOwnBody(worldId, index, state, shapeId);
+        Add(bodyId, shapeId, state.color, attached, transform);
+    }
     
-    Rectangle rect = {
-        x,
-        y,
-        BRICK_WIDTH * 2,
-        BRICK_HEIGHT * 2
-    };
+    flags[index] = state.flags;
+    return index;
+}
+
+void BrickStore::WriteState(int index, int wall, BrickState& state) const {
+    state = BrickState{};
+    state.wall = wall;
+    state.color = colors[index];
+    state.flags = flags[index];
     
-    Vector2 origin = { BRICK_WIDTH, BRICK_HEIGHT };
+    // Culled bricks have no body, keep where they were last seen
+    if (IsCulled(index)) {
+        const b2Transform& transform = transforms.Current(index);
+        state.position = transform.p;
+        state.rotation = transform.q;
+        return;
+    }
     
-    // Draw filled brick
-    DrawRectanglePro(rect, origin, angle, color);
+    // Attached bricks share the wall's body, their own transform is the one they were given
+    b2BodyId bodyId = bodyIds[index];
+    b2Transform transform = IsAttached(index) ? transforms.Current(index) : b2Body_GetTransform(bodyId);
+    state.position = transform.p;
+    state.rotation = transform.q;
+    state.linearVelocity = b2Body_GetLinearVelocity(bodyId);
+    state.angularVelocity = b2Body_GetAngularVelocity(bodyId);
+    state.awake = b2Body_IsAwake(bodyId) ? 1 : 0;
+}
+
+void BrickStore::MoveToWorld(int index, b2WorldId worldId) {
+    if (IsAttached(index) || IsCulled(index)) return;
     
-    // Draw border inset within the brick dimensions
-    const float borderThickness = 2.0f;
-    const float inset = borderThickness / 2.0f;
+    BrickState state;
+    WriteState(index, -1, state);
+    b2DestroyBody(bodyIds[index]);
+    bodyIds[index] = CreateOwnBody(worldId, index, state, shapeIds[index]);
+}
+
+b2BodyId BrickStore::CreateGhost(int index, b2WorldId worldId) const {
+    b2BodyDef bodyDef = b2DefaultBodyDef();
+    bodyDef.type = b2_kinematicBody;
+    bodyDef.position = b2Body_GetPosition(bodyIds[index]);
+    bodyDef.rotation = b2Body_GetRotation(bodyIds[index]);
+    b2BodyId bodyId = b2CreateBody(worldId, &bodyDef);  // Null user data, its move events decode to no entity
     
-    // Calculate the four corners of the inset rectangle (local coordinates)
-    float halfWidth = BRICK_WIDTH - inset;
-    float halfHeight = BRICK_HEIGHT - inset;
+    b2Polygon box = MakeBrickBox({0.0f, 0.0f});
+    b2ShapeDef shapeDef = MakeBrickShapeDef(index, false);
+    shapeDef.userData = EncodeEntity(EntityKind::Ghost, -1);  // Skipped by broadphase queries
+    b2CreatePolygonShape(bodyId, &shapeDef, &box);
+    return bodyId;
+}
+
+b2ShapeId BrickStore::CreateWallGhost(int index, b2BodyId bodyId) const {
+    b2Polygon box = MakeBrickBox(transforms.Current(index).p);
+    b2ShapeDef shapeDef = MakeBrickShapeDef(index, true);
+    shapeDef.userData = EncodeEntity(EntityKind::Ghost, index);  // Hits break the brick itself
+    return b2CreatePolygonShape(bodyId, &shapeDef, &box);
+}
+
+b2BodyId BrickStore::AcquireBody(b2WorldId worldId, int index, const b2Transform& transform) {
+    // Pooled bodies stay in the world they were created in, sharded games have several
+    int pooled = (int)pooledBodies.size() - 1;
+    while (pooled >= 0 && !SameWorld(b2Body_GetWorld(pooledBodies[pooled]), worldId)) pooled--;
     
-    Vector2 corners[4] = {
-        { -halfWidth, -halfHeight },  // Top-left
-        {  halfWidth, -halfHeight },  // Top-right
-        {  halfWidth,  halfHeight },  // Bottom-right
-        { -halfWidth,  halfHeight }   // Bottom-left
-    };
+    if (pooled < 0) {
+        b2BodyDef bodyDef = MakeBrickBodyDef(index, b2_dynamicBody, transform.p, transform.q);
+        b2BodyId bodyId = b2CreateBody(worldId, &bodyDef);
+        
+        b2Polygon box = MakeBrickBox({0.0f, 0.0f});
+        b2ShapeDef shapeDef = MakeBrickShapeDef(index, false);
+        b2CreatePolygonShape(bodyId, &shapeDef, &box);
+        return bodyId;
+    }
     
-    // Rotate corners and translate to world position
-    float angleRad = angle * DEG2RAD;
-    float cosA = cosf(angleRad);
-    float sinA = sinf(angleRad);
+    // Reuse a culled brick's body: re-own it, reset its motion and wake it up
+    b2BodyId bodyId = pooledBodies[pooled];
+    pooledBodies[pooled] = pooledBodies.back();
+    pooledBodies.pop_back();
     
-    Vector2 worldCorners[4];
-    for (int i = 0; i < 4; i++) {
-        worldCorners[i].x = x + corners[i].x * cosA - corners[i].y * sinA;
-        worldCorners[i].y = y + corners[i].x * sinA + corners[i].y * cosA;
+    b2ShapeId shapeId;
+    b2Body_GetShapes(bodyId, &shapeId, 1);
+    b2Body_SetUserData(bodyId, EncodeEntity(EntityKind::Brick, index));
+    b2Shape_SetUserData(shapeId, EncodeEntity(EntityKind::Brick, index));
+    
+    b2Body_SetTransform(bodyId, transform.p, transform.q);
+    b2Body_SetLinearVelocity(bodyId, {0.0f, 0.0f});
+    b2Body_SetAngularVelocity(bodyId, 0.0f);
+    b2Body_Enable(bodyId);
+    b2Body_SetAwake(bodyId, true);
+    return bodyId;
+}
+
+void BrickStore::Freeze(int index) {
+    if (IsAttached(index) || IsFrozen(index) || IsCulled(index)) return;
+    
+    flags[index] |= FLAG_FROZEN;
+    b2Body_SetType(bodyIds[index], b2_staticBody);
+    
+    // Static bodies report no more moves, so stop interpolating from the last one
+    transforms.Reset(index, b2Body_GetTransform(bodyIds[index]));
+}
+
+void BrickStore::Cull(int index) {
+    if (IsAttached(index) || IsCulled(index)) return;
+    
+    // Frozen debris is static, pooled bodies must come back dynamic
+    if (IsFrozen(index)) {
+        b2Body_SetType(bodyIds[index], b2_dynamicBody);
     }
     
-    // Draw the four border lines
-    Color borderColor = ColorBrightness(color, -0.3f);  // Darker shade of brick color
-    for (int i = 0; i < 4; i++) {
-        DrawLineEx(worldCorners[i], worldCorners[(i + 1) % 4], borderThickness, borderColor);
+    flags[index] |= FLAG_CULLED;
+    flags[index] &= ~FLAG_FROZEN;
+    
+    // Disabled bodies leave the broadphase and the solver but keep their shape
+    b2Body_Disable(bodyIds[index]);
+    pooledBodies.push_back(bodyIds[index]);
+    bodyIds[index] = b2_nullBodyId;
+    shapeIds[index] = b2_nullShapeId;
+}
+
+int BrickStore::Add(b2BodyId bodyId, b2ShapeId shapeId, Color color, bool attached, const b2Transform& transform) {
+    bodyIds.push_back(bodyId);
+    shapeIds.push_back(shapeId);
+    colors.push_back(color);
+    borderColors.push_back(ColorBrightness(color, -0.3f));
+    flags.push_back(attached ? FLAG_ATTACHED : 0);
+    transforms.Add(transform);
+    
+    return Count() - 1;
+}
+
+void BrickStore::Reserve(int count) {
+    bodyIds.reserve(count);
+    shapeIds.reserve(count);
+    colors.reserve(count);
+    borderColors.reserve(count);
+    flags.reserve(count);
+    transforms.Reserve(count);
+}
+
+int BrickStore::FromShape(b2ShapeId shapeId) {
+    // Ball and brick shapes carry their entity, world bounds leave it null
+    // Ghosts of attached bricks stand in for their brick in a neighbouring shard
+    EntityRef ref = DecodeEntity(b2Shape_GetUserData(shapeId));
+    return ref.kind == EntityKind::Brick || ref.kind == EntityKind::Ghost ? ref.index : -1;
+}
+
+void BrickStore::Break(int index, b2Vec2 impactVelocity) {
+    if (!IsAttached(index)) return;
+    
+    flags[index] &= ~FLAG_ATTACHED;
+    
+    EntityRef owner = DecodeEntity(b2Body_GetUserData(bodyIds[index]));
+    if (owner.kind == EntityKind::Brick && owner.index == index) {
+        // The brick has a body of its own, change it to a dynamic body in place
+        b2Body_SetType(bodyIds[index], b2_dynamicBody);
+        b2Shape_EnableHitEvents(shapeIds[index], false);
+    } else {
+        // Split the brick off the wall's shared body into a body of its own
+        b2BodyId wallBodyId = bodyIds[index];
+        b2Transform transform = transforms.Current(index);
+        b2DestroyShape(shapeIds[index], false);  // The wall is static, no mass to update
+        
+        bodyIds[index] = AcquireBody(b2Body_GetWorld(wallBodyId), index, transform);
+        b2Body_GetShapes(bodyIds[index], &shapeIds[index], 1);
+    }
+    
+    // Apply impulse in the direction of impact with reduced magnitude
+    b2Vec2 impulse = {
+        impactVelocity.x * 0.3f,
+        impactVelocity.y * 0.3f
+    };
+    b2Body_ApplyLinearImpulseToCenter(bodyIds[index], impulse, true);
+}
+
+void BrickStore::AppendTo(BrickBatch& batch, const TrackedVector<int, MemorySystem::Render>& indices, float alpha, uint64_t latestStep) const {
+    for (int i : indices) {
+        if (flags[i] & FLAG_CULLED) continue;
+        
+        // Transform interpolated between physics steps (convert meters to pixels)
+        b2Transform transform = transforms.Interpolated(i, alpha, latestStep);
+        Vector2 position = {
+            transform.p.x * Game::PIXELS_PER_METER,
+            transform.p.y * Game::PIXELS_PER_METER
+        };
+        
+        batch.AddBrick(position, transform.q, BRICK_WIDTH, BRICK_HEIGHT,
+                       BORDER_THICKNESS, colors[i], borderColors[i]);
     }
 }
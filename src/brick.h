@@ -1,27 +1,103 @@
 #pragma once
 #include <raylib.h>
 #include <box2d/box2d.h>
-#include "IPhysicsBody.h"
-#include "IRenderable.h"
+#include <cstdint>
+#include <vector>
+#include "transform_history.h"
+#include "memory.h"
 
-class Game;
+class BrickBatch;
+struct BrickState;
 
-class Brick : public IPhysicsBody, public IRenderable {
+// Structure-of-arrays storage for every brick in the game
+class BrickStore {
 public:
-    Brick(Game* game, float x, float y, Color color, bool attached = true);
-    ~Brick() override = default;
-
-    void Update() override;
-    void Render() const override;
-    bool IsAttached() const { return attached; }
-    void Detach() { attached = false; }
-    b2ShapeId GetShapeId() const { return shapeId; }
+    // Create a brick with its own body centred on (x, y) in pixels and return its index
+    // Attached bricks are static until a hit breaks them off
+    int Create(b2WorldId worldId, float x, float y, Color color, bool attached = true);
+    
+    // Create an attached brick as one more shape on a wall's static body,
+    // centred on (x, y) in world pixels, and return its index
+    int CreateInWall(b2BodyId wallBodyId, float x, float y, Color color);
+    
+    // Recreate a brick from a snapshot and return its index
+    // Attached bricks go back onto the given wall body, the others get a body
+    // of their own unless they were culled
+    int Restore(b2WorldId worldId, b2BodyId wallBodyId, const BrickState& state);
+    
+    // Fill a snapshot record with the brick's current state, wall is the
+    // snapshot index of the wall carrying it or -1
+    void WriteState(int index, int wall, BrickState& state) const;
+    
+    // Recreate a broken brick's body with its current motion in another
+    // world, for debris crossing into another shard
+    void MoveToWorld(int index, b2WorldId worldId);
+    
+    // Kinematic copy of a broken brick in another world, mirrored by ShardedWorld
+    b2BodyId CreateGhost(int index, b2WorldId worldId) const;
+    
+    // Static copy of an attached brick as a shape on bodyId, a static body at
+    // the origin of another world; hits on it are reported for the brick
+    b2ShapeId CreateWallGhost(int index, b2BodyId bodyId) const;
+    
+    int Count() const { return (int)bodyIds.size(); }
+    void Reserve(int count);
+    b2BodyId GetBodyId(int index) const { return bodyIds[index]; }
+    b2ShapeId GetShapeId(int index) const { return shapeIds[index]; }
+    Color GetColor(int index) const { return colors[index]; }
+    const b2Transform& GetTransform(int index) const { return transforms.Current(index); }
+    bool IsAttached(int index) const { return (flags[index] & FLAG_ATTACHED) != 0; }
+    bool IsFrozen(int index) const { return (flags[index] & FLAG_FROZEN) != 0; }
+    bool IsCulled(int index) const { return (flags[index] & FLAG_CULLED) != 0; }
+    uint8_t GetFlags(int index) const { return flags[index]; }
+    bool MovedIn(int index, uint64_t step) const { return transforms.MovedIn(index, step); }
+    
+    // Break the brick off its wall, pushing it along the impacting body's velocity
+    // A brick sharing its wall's body is split off into a dynamic body of its
+    // own, taken from the body pool when one is available
+    // Broken bricks no longer request hit events
+    void Break(int index, b2Vec2 impactVelocity);
+    
+    // Turn a broken brick back into a static body where it lies
+    void Freeze(int index);
+    
+    // Remove a broken brick from the simulation and the screen, returning
+    // its body to the pool for the next brick that breaks
+    void Cull(int index);
+    
+    int PooledBodyCount() const { return (int)pooledBodies.size(); }
+    
+    void SyncTransform(int index, const b2Transform& transform, uint64_t step) {
+        transforms.Sync(index, transform, step);
+    }
+    
+    // Queue the quads of the bricks among indices, interpolated between the
+    // last two physics steps
+    void AppendTo(BrickBatch& batch, const TrackedVector<int, MemorySystem::Render>& indices, float alpha, uint64_t latestStep) const;
+    
+    // Index of the brick owning the given shape, or -1 if the shape is not a
+    // brick or a ghost of an attached brick
+    static int FromShape(b2ShapeId shapeId);
 
-private:
-    b2ShapeId shapeId;
-    Color color;
-    bool attached;  // Whether brick is still attached to wall
+    static constexpr uint8_t FLAG_ATTACHED = 1 << 0;  // Still part of its wall
+    static constexpr uint8_t FLAG_FROZEN = 1 << 1;    // Settled debris made static again
+    static constexpr uint8_t FLAG_CULLED = 1 << 2;    // Debris removed, body back in the pool
     
     static constexpr float BRICK_WIDTH = 7.5f;   // Half ball radius
     static constexpr float BRICK_HEIGHT = 7.5f;  // Half ball radius
+    static constexpr float BORDER_THICKNESS = 2.0f;
+
+private:
+    TrackedVector<b2BodyId, MemorySystem::Entities> bodyIds;  // Shared by all attached bricks of a wall
+    TrackedVector<b2ShapeId, MemorySystem::Entities> shapeIds;
+    TrackedVector<Color, MemorySystem::Entities> colors;
+    TrackedVector<Color, MemorySystem::Entities> borderColors;  // Darker shade of the brick colour
+    TrackedVector<uint8_t, MemorySystem::Entities> flags;
+    TransformHistory transforms;
+    
+    // Disabled single-brick dynamic bodies of culled debris, ready for reuse
+    TrackedVector<b2BodyId, MemorySystem::Entities> pooledBodies;
+    
+    b2BodyId AcquireBody(b2WorldId worldId, int index, const b2Transform& transform);
+    int Add(b2BodyId bodyId, b2ShapeId shapeId, Color color, bool attached, const b2Transform& transform);
 };
@@ -0,0 +1,60 @@
+#include "brick_batch.h"
+#include <rlgl.h>
+
+void BrickBatch::Clear() {
+    vertices.clear();
+}
+
+void BrickBatch::AddBrick(Vector2 position, b2Rot rotation, float halfWidth, float halfHeight,
+                          float borderThickness, Color fillColor, Color borderColor) {
+    // Filled brick
+    AddQuad(position, rotation, -halfWidth, -halfHeight, halfWidth, halfHeight, fillColor);
+    
+    // Border as four non-overlapping strips along the inside of the outline
+    float innerWidth = halfWidth - borderThickness;
+    float innerHeight = halfHeight - borderThickness;
+    AddQuad(position, rotation, -halfWidth, -halfHeight, halfWidth, -innerHeight, borderColor);    // Top
+    AddQuad(position, rotation, -halfWidth, innerHeight, halfWidth, halfHeight, borderColor);      // Bottom
+    AddQuad(position, rotation, -halfWidth, -innerHeight, -innerWidth, innerHeight, borderColor);  // Left
+    AddQuad(position, rotation, innerWidth, -innerHeight, halfWidth, innerHeight, borderColor);    // Right
+}
+
+void BrickBatch::AddQuad(Vector2 position, b2Rot rotation, float minX, float minY,
+                         float maxX, float maxY, Color color) {
+    // Corners in the same winding raylib uses for DrawRectanglePro
+    const float localX[4] = { minX, minX, maxX, maxX };
+    const float localY[4] = { minY, maxY, maxY, minY };
+    
+    // The rotation already carries cosine and sine, no trigonometry needed
+    for (int i = 0; i < 4; i++) {
+        vertices.push_back(Vertex{
+            position.x + localX[i] * rotation.c - localY[i] * rotation.s,
+            position.y + localX[i] * rotation.s + localY[i] * rotation.c,
+            color
+        });
+    }
+}
+
+void BrickBatch::Draw() const {
+    if (vertices.empty()) return;
+    
+    // Quads go into rlgl's streaming vertex buffer, which only issues a draw
+    // call when it fills up or the frame ends
+    rlSetTexture(rlGetTextureIdDefault());
+    rlBegin(RL_QUADS);
+    
+    for (size_t i = 0; i < vertices.size(); i += 4) {
+        // Flush a full buffer between quads rather than in the middle of one
+        rlCheckRenderBatchLimit(4);
+        
+        for (size_t j = i; j < i + 4; j++) {
+            const Vertex& vertex = vertices[j];
+            rlColor4ub(vertex.color.r, vertex.color.g, vertex.color.b, vertex.color.a);
+            rlTexCoord2f(0.0f, 0.0f);
+            rlVertex2f(vertex.x, vertex.y);
+        }
+    }
+    
+    rlEnd();
+    rlSetTexture(0);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <raylib.h>
+#include <box2d/box2d.h>
+#include <vector>
+#include "memory.h"
+
+// Collects the fill and border quads of many bricks into one vertex buffer
+// and submits them through rlgl in a single pass, so the number of draw
+// calls stays flat as the brick count grows
+class BrickBatch {
+public:
+    BrickBatch() = default;
+    ~BrickBatch() = default;
+
+    // Drop the quads of the previous frame, keeping the buffer's capacity
+    void Clear();
+    
+    // Queue a brick centred on position (pixels), rotated by rotation
+    // The border is drawn inside the brick's outline
+    void AddBrick(Vector2 position, b2Rot rotation, float halfWidth, float halfHeight,
+                  float borderThickness, Color fillColor, Color borderColor);
+    
+    // Submit every queued quad
+    void Draw() const;
+    
+    int QuadCount() const { return (int)vertices.size() / 4; }
+
+private:
+    struct Vertex {
+        float x, y;
+        Color color;
+    };
+    
+    TrackedVector<Vertex, MemorySystem::Render> vertices;  // Four per quad, counter-clockwise
+    
+    // Append a quad given by its corners in brick-local pixels
+    void AddQuad(Vector2 position, b2Rot rotation, float minX, float minY,
+                 float maxX, float maxY, Color color);
+};
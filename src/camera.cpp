@@ -0,0 +1,45 @@
+#include "camera.h"
+#include <algorithm>
+
+GameCamera::GameCamera(float screenWidth, float screenHeight)
+    : screenWidth(screenWidth)
+    , screenHeight(screenHeight)
+{
+    // Screen centre on screen centre at zoom 1, so the world's top-left corner
+    // starts at the window's top-left corner as before
+    camera.offset = { screenWidth / 2.0f, screenHeight / 2.0f };
+    camera.target = camera.offset;
+    camera.rotation = 0.0f;
+    camera.zoom = 1.0f;
+}
+
+void GameCamera::Pan(Vector2 screenDelta) {
+    camera.target.x -= screenDelta.x / camera.zoom;
+    camera.target.y -= screenDelta.y / camera.zoom;
+}
+
+void GameCamera::ZoomAt(Vector2 screenPoint, float factor) {
+    Vector2 before = GetScreenToWorld2D(screenPoint, camera);
+    camera.zoom = std::clamp(camera.zoom * factor, MIN_ZOOM, MAX_ZOOM);
+    Vector2 after = GetScreenToWorld2D(screenPoint, camera);
+    
+    camera.target.x += before.x - after.x;
+    camera.target.y += before.y - after.y;
+}
+
+void GameCamera::FitWorld(float worldWidth, float worldHeight) {
+    camera.target = { worldWidth / 2.0f, worldHeight / 2.0f };
+    camera.zoom = std::clamp(std::min(screenWidth / worldWidth, screenHeight / worldHeight), MIN_ZOOM, MAX_ZOOM);
+}
+
+Rectangle GameCamera::VisibleArea() const {
+    // The camera never rotates, so the view is an axis-aligned rectangle
+    float width = screenWidth / camera.zoom;
+    float height = screenHeight / camera.zoom;
+    return Rectangle {
+        camera.target.x - camera.offset.x / camera.zoom,
+        camera.target.y - camera.offset.y / camera.zoom,
+        width,
+        height
+    };
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <raylib.h>
+
+// 2D camera over the play area, which may be much larger than the screen
+// Pans and zooms around a point given in screen pixels and reports the part
+// of the world on screen so rendering can skip everything else
+class GameCamera {
+public:
+    GameCamera(float screenWidth, float screenHeight);
+
+    // Move the view by a distance in screen pixels, e.g. a mouse drag
+    void Pan(Vector2 screenDelta);
+    
+    // Scale the zoom by factor, keeping the world point under screenPoint in place
+    void ZoomAt(Vector2 screenPoint, float factor);
+    
+    // Centre the world and zoom so all of it fits on screen
+    void FitWorld(float worldWidth, float worldHeight);
+    
+    const Camera2D& Get() const { return camera; }
+    float Zoom() const { return camera.zoom; }
+    
+    // Area of the world on screen, in world pixels
+    Rectangle VisibleArea() const;
+
+    static constexpr float MIN_ZOOM = 0.02f;
+    static constexpr float MAX_ZOOM = 8.0f;
+
+private:
+    Camera2D camera;
+    float screenWidth;
+    float screenHeight;
+};
@@ -0,0 +1,86 @@
+#include "debris.h"
+#include "brick.h"
+#include "snapshot.h"
+#include <box2d/box2d.h>
+#include <algorithm>
+
+DebrisManager::DebrisManager(int settleSteps, int maxActive, bool cull)
+    : settleSteps(std::max(settleSteps, 1))
+    , maxActive(std::max(maxActive, 0))
+    , cull(cull)
+{
+    // Debris beyond the budget is retired every step, so the list rarely outgrows it
+    active.reserve(this->maxActive);
+}
+
+void DebrisManager::SetLimits(int settleSteps, int maxActive) {
+    this->settleSteps = std::max(settleSteps, 1);
+    this->maxActive = std::max(maxActive, 0);
+}
+
+void DebrisManager::Track(int brickIndex) {
+    active.push_back(Debris{ brickIndex, 0 });
+}
+
+void DebrisManager::WriteState(DebrisState* states) const {
+    for (size_t i = 0; i < active.size(); i++) {
+        states[i] = DebrisState{};
+        states[i].brickIndex = active[i].brickIndex;
+        states[i].restingSince = active[i].restingSince;
+    }
+}
+
+void DebrisManager::Restore(const DebrisState* states, int count, int frozen, int culled) {
+    active.clear();
+    active.reserve(count);
+    for (int i = 0; i < count; i++) {
+        active.push_back(Debris{ states[i].brickIndex, states[i].restingSince });
+    }
+    frozenCount = frozen;
+    culledCount = culled;
+}
+
+void DebrisManager::Update(BrickStore& bricks, uint64_t step) {
+    if (active.empty()) return;
+    
+    // Box2D puts resting islands to sleep, so a sleeping body is settled
+    // Retire each piece once it has slept for the configured time
+    size_t kept = 0;
+    for (size_t i = 0; i < active.size(); i++) {
+        Debris debris = active[i];
+        
+        if (b2Body_IsAwake(bricks.GetBodyId(debris.brickIndex))) {
+            debris.restingSince = 0;
+        } else if (debris.restingSince == 0) {
+            debris.restingSince = step;
+        }
+        
+        if (debris.restingSince != 0 && step - debris.restingSince >= (uint64_t)settleSteps) {
+            Retire(bricks, debris.brickIndex);
+            continue;
+        }
+        
+        // Compact in place so the list stays ordered oldest first
+        active[kept++] = debris;
+    }
+    active.resize(kept);
+    
+    // Over budget, retire the oldest pieces even if they are still moving
+    if ((int)active.size() > maxActive) {
+        size_t excess = active.size() - (size_t)maxActive;
+        for (size_t i = 0; i < excess; i++) {
+            Retire(bricks, active[i].brickIndex);
+        }
+        active.erase(active.begin(), active.begin() + excess);
+    }
+}
+
+void DebrisManager::Retire(BrickStore& bricks, int brickIndex) {
+    if (cull) {
+        bricks.Cull(brickIndex);
+        culledCount++;
+    } else {
+        bricks.Freeze(brickIndex);
+        frozenCount++;
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "memory.h"
+
+class BrickStore;
+struct DebrisState;
+
+// Keeps the cost of broken bricks bounded over long sessions
+// Debris that has rested long enough, or the oldest debris once more than
+// the budget is moving, is retired: frozen back into a static body or
+// culled, with culled bodies recycled by the BrickStore's pool
+class DebrisManager {
+public:
+    // settleSteps: physics steps debris must rest before it is retired
+    // maxActive: dynamic debris allowed before the oldest is retired early
+    // cull: remove retired debris instead of freezing it
+    DebrisManager(int settleSteps, int maxActive, bool cull);
+
+    // Start tracking a brick that just broke off its wall
+    void Track(int brickIndex);
+    
+    // Retire settled and over-budget debris, call once per physics step
+    void Update(BrickStore& bricks, uint64_t step);
+    
+    // Change the settle time and budget, e.g. to shed physics work under load
+    // Debris over a lowered budget is retired by the next Update
+    void SetLimits(int settleSteps, int maxActive);
+    int SettleSteps() const { return settleSteps; }
+    int MaxActive() const { return maxActive; }
+    
+    int ActiveCount() const { return (int)active.size(); }
+    int FrozenCount() const { return frozenCount; }
+    int CulledCount() const { return culledCount; }
+    
+    // Copy the tracked debris into ActiveCount() snapshot records, oldest first
+    void WriteState(DebrisState* states) const;
+    
+    // Replace the tracked debris and counters with a snapshot's
+    void Restore(const DebrisState* states, int count, int frozen, int culled);
+
+private:
+    struct Debris {
+        int brickIndex;
+        uint64_t restingSince;  // Step the body fell asleep, 0 while it moves
+    };
+    
+    TrackedVector<Debris, MemorySystem::Debris> active;  // Oldest first
+    int settleSteps;
+    int maxActive;
+    bool cull;
+    int frozenCount = 0;
+    int culledCount = 0;
+
+    void Retire(BrickStore& bricks, int brickIndex);
+};
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <box2d/box2d.h>
+#include <cstdint>
+#include <vector>
+#include "ball.h"
+#include "brick.h"
+#include "memory.h"
+
+// Kind of entity a Box2D body or shape belongs to
+enum class EntityKind : uint8_t {
+    None,
+    Ball,
+    Brick,
+    Ghost  // Copy of a body owned by another shard, see ShardedWorld
+};
+
+// Reference to an entity by its index in the store of its kind
+// Ghosts of attached bricks refer to their brick, other ghosts to nothing (-1)
+struct EntityRef {
+    EntityKind kind = EntityKind::None;
+    int index = -1;
+};
+
+// Pack an entity reference into Box2D user data
+// The kind lives in the low bits and the index is offset by one so that
+// null user data always decodes to EntityKind::None
+inline void* EncodeEntity(EntityKind kind, int index) {
+    uintptr_t value = ((uintptr_t)(index + 1) << 2) | (uintptr_t)kind;
+    return reinterpret_cast<void*>(value);
+}
+
+inline EntityRef DecodeEntity(void* userData) {
+    uintptr_t value = reinterpret_cast<uintptr_t>(userData);
+    if (value == 0) return EntityRef{};
+    
+    EntityRef ref;
+    ref.kind = (EntityKind)(value & 3);
+    ref.index = (int)(value >> 2) - 1;
+    return ref;
+}
+
+// Whether two ids refer to the same live world, such as a body's and a shard's
+inline bool SameWorld(b2WorldId a, b2WorldId b) {
+    return a.index1 == b.index1 && a.generation == b.generation;
+}
+
+// All simulated entities, each kind kept in its own structure of arrays
+struct EntityStore {
+    BallStore balls;
+    BrickStore bricks;
+    
+    // Copy the transforms of bodies that moved during the given step
+    void SyncMovedBodies(const b2BodyEvents& events, uint64_t step) {
+        for (int i = 0; i < events.moveCount; i++) {
+            const b2BodyMoveEvent& move = events.moveEvents[i];
+            EntityRef ref = DecodeEntity(move.userData);
+            
+            if (ref.kind == EntityKind::Ball) {
+                balls.SyncTransform(ref.index, move.transform, step);
+            } else if (ref.kind == EntityKind::Brick) {
+                bricks.SyncTransform(ref.index, move.transform, step);
+            }
+        }
+    }
+};
+
+// Entities whose shapes overlap an area of the world, gathered from Box2D's
+// broadphase trees so the cost follows the size of the area, not of the world
+struct VisibleEntities {
+    TrackedVector<int, MemorySystem::Render> balls;
+    TrackedVector<int, MemorySystem::Render> bricks;
+    
+    // Replace the contents with every ball and brick overlapping area (meters)
+    // Culled bricks have disabled bodies, which are not in the broadphase
+    void Collect(b2WorldId worldId, b2AABB area) {
+        Clear();
+        Add(worldId, area);
+    }
+    
+    void Clear() {
+        balls.clear();
+        bricks.clear();
+    }
+    
+    // Append what overlaps area in one more world, for sharded games
+    // Ghosts are skipped, their owner is found in its own world
+    void Add(b2WorldId worldId, b2AABB area) {
+        b2World_OverlapAABB(worldId, area, b2DefaultQueryFilter(), &VisibleEntities::AddShape, this);
+    }
+    
+private:
+    static bool AddShape(b2ShapeId shapeId, void* context) {
+        VisibleEntities* visible = (VisibleEntities*)context;
+        EntityRef ref = DecodeEntity(b2Shape_GetUserData(shapeId));
+        
+        if (ref.kind == EntityKind::Ball) {
+            visible->balls.push_back(ref.index);
+        } else if (ref.kind == EntityKind::Brick) {
+            visible->bricks.push_back(ref.index);
+        }
+        return true;  // Keep going
+    }
+};
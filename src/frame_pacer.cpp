@@ -0,0 +1,78 @@
+#include "frame_pacer.h"
+#include <raylib.h>
+#include <algorithm>
+#include <cstring>
+
+FramePacer::FramePacer(PacingMode mode, int targetFps, bool lateInput)
+    : mode(mode)
+    , targetFps(targetFps)
+    , lateInput(lateInput)
+{
+}
+
+void FramePacer::ConfigureWindow() const {
+    if (mode == PacingMode::Vsync) {
+        SetConfigFlags(FLAG_VSYNC_HINT);
+    }
+}
+
+void FramePacer::Start() {
+    if (mode == PacingMode::Vsync) {
+        int refreshRate = GetMonitorRefreshRate(GetCurrentMonitor());
+        period = 1.0 / (refreshRate > 0 ? refreshRate : targetFps);
+    } else if (mode == PacingMode::Capped) {
+        period = 1.0 / targetFps;
+    }
+
+    // raylib's limiter sleeps at the end of EndDrawing and polls input after
+    // it; late input does that sleep itself, before the frame samples input
+    bool rayLimiter = mode == PacingMode::Capped && !lateInput;
+    SetTargetFPS(rayLimiter ? targetFps : 0);
+}
+
+double FramePacer::WorkEstimate() const {
+    double work = *std::max_element(workSeconds, workSeconds + WORK_HISTORY);
+    double swap = mode == PacingMode::Vsync
+        ? VSYNC_SWAP_SECONDS
+        : *std::max_element(swapSeconds, swapSeconds + WORK_HISTORY);
+    return work + swap + MARGIN_SECONDS;
+}
+
+bool FramePacer::WaitForInput() {
+    if (!lateInput || period <= 0.0 || !hasPresented) {
+        sampled = Clock::now();
+        return false;
+    }
+
+    // The next present is due a period after the last one; with vsync the
+    // swap returns at the refresh, so this lands on the next one
+    double wait = period - WorkEstimate()
+        - std::chrono::duration<double>(Clock::now() - lastPresent).count();
+    if (wait > 0.0) {
+        WaitTime(wait);
+    }
+    sampled = Clock::now();
+    return wait > 0.0;
+}
+
+void FramePacer::FramePresented(Clock::time_point presentStart) {
+    lastPresent = Clock::now();
+    hasPresented = true;
+
+    workSeconds[workHead] = std::chrono::duration<double>(presentStart - sampled).count();
+    swapSeconds[workHead] = std::chrono::duration<double>(lastPresent - presentStart).count();
+    workHead = (workHead + 1) % WORK_HISTORY;
+}
+
+bool FramePacer::ParseMode(const char* text, PacingMode& mode) {
+    if (strcmp(text, "capped") == 0) {
+        mode = PacingMode::Capped;
+    } else if (strcmp(text, "vsync") == 0) {
+        mode = PacingMode::Vsync;
+    } else if (strcmp(text, "uncapped") == 0) {
+        mode = PacingMode::Uncapped;
+    } else {
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <chrono>
+
+// How the windowed frame loop is paced
+enum class PacingMode {
+    Capped,    // Sleep to the game's target frame rate (the default)
+    Vsync,     // Let the buffer swap wait for the display's refresh
+    Uncapped,  // Run frames back to back, neither capped nor synced
+};
+
+// Paces the windowed frames and, in low-latency mode, delays input sampling
+// until just before the frame must start to make its present on time
+// The work of a frame, from sampling to the start of EndDrawing, is estimated
+// from the slowest of the recent frames plus a margin, so a frame that runs
+// long only costs its own present rather than queueing up a backlog
+// The swap is budgeted apart: with vsync it blocks until the refresh, so its
+// measured time says nothing about its cost
+class FramePacer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    FramePacer(PacingMode mode, int targetFps, bool lateInput);
+
+    // Window flags of the mode, call before InitWindow
+    void ConfigureWindow() const;
+
+    // Set raylib's own frame limiter, call once the window exists
+    void Start();
+
+    // Sleep until input should be sampled for the next frame
+    // Returns whether it slept, in which case input that arrived during the
+    // sleep is only seen once events are polled again
+    bool WaitForInput();
+
+    // The frame using the input sampled after WaitForInput has been presented,
+    // its EndDrawing having started at presentStart
+    void FramePresented(Clock::time_point presentStart);
+
+    PacingMode Mode() const { return mode; }
+    bool IsLateInput() const { return lateInput; }
+
+    // Parse "capped", "vsync" or "uncapped"
+    static bool ParseMode(const char* text, PacingMode& mode);
+
+private:
+    static constexpr int WORK_HISTORY = 32;  // Frames the work estimate looks back over
+    static constexpr double MARGIN_SECONDS = 0.001;  // Slack for sleep and swap jitter
+    static constexpr double VSYNC_SWAP_SECONDS = 0.002;  // Swap budget when it waits for the refresh
+
+    PacingMode mode;
+    int targetFps;
+    bool lateInput;
+    double period = 0.0;  // Seconds between presents, 0 when uncapped
+
+    Clock::time_point lastPresent;
+    Clock::time_point sampled;
+    bool hasPresented = false;
+    double workSeconds[WORK_HISTORY] = {};   // Sampling to the start of EndDrawing
+    double swapSeconds[WORK_HISTORY] = {};   // EndDrawing
+    int workHead = 0;
+
+    double WorkEstimate() const;
+};
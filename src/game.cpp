@@ -1,56 +1,309 @@
 #include "game.h"
-#include "ball.h"
-#include "wall.h"
+#include "render_frame.h"
+#include "background.h"
+#include "ball_renderer.h"
+#include "camera.h"
+#include "light_field.h"
+#include "lightmap.h"
+#include "debris.h"
 #include "hud.h"
+#include "profiler.h"
 #include "FakeLight.h"
+#include "task_scheduler.h"
+#include "scene.h"
+#include "input_recording.h"
+#include "snapshot.h"
+#include "memory.h"
+#include "sharded_world.h"
+#include "quality_governor.h"
+#include "spectator_stream.h"
 #include <raylib.h>
+#include <algorithm>
 #include <cmath>
+#include <cstdio>
+#include <cstring>
 
-Game::Game() {
+Game::Game(const GameConfig& config)
+    : config(config), random(config.seed)
+{
+    CreateWorld();
+    BuildScene(MakeDefaultScene(screenWidth, screenHeight, random));
+}
+
+Game::Game(const GameConfig& config, const Scene& scene)
+    : config(config), random(config.seed)
+{
+    CreateWorld();
+    BuildScene(scene);
+}
+
+Game::Game(const GameConfig& config, const WorldSnapshot& snapshot)
+    : config(config), random(config.seed)
+{
+    CreateWorld();
+    RestoreSnapshot(snapshot);
+}
+
+void Game::CreateWorld() {
     running = true;
     
+    // Retire broken bricks once they settle, counted in physics steps
+    int settleSteps = (int)(config.debrisSettleTime * config.simRate);
+    debris = std::make_unique<DebrisManager>(settleSteps, config.maxActiveDebris, config.cullDebris);
+    
+    // Background shader is loaded on first draw, once a window exists
+    background = std::make_unique<Background>();
+    
+    // Frames are prepared and drawn in turn: all bricks through one batch,
+    // balls through instanced renderers lit by every light of the scene
+    frames[0] = std::make_unique<RenderFrame>();
+    frames[1] = std::make_unique<RenderFrame>();
+    enemyRenderer = std::make_unique<BallRenderer>();
+    playerRenderer = std::make_unique<BallRenderer>();
+    lightField = std::make_unique<LightField>();
+    if (config.shadows) lightmap = std::make_unique<Lightmap>();
+    
+    // Camera starts on the top-left screen of the world
+    camera = std::make_unique<GameCamera>(screenWidth, screenHeight);
+    
+    // Create HUD and the profiler it reports from
+    hud = std::make_unique<Hud>(this);
+    profiler = std::make_unique<Profiler>();
+    
+    // Full quality until the governor sees frames close to their budget
+    governor = std::make_unique<QualityGovernor>(config.frameBudgetMs);
+    subStepCount = config.subStepCount;
+    
+    // A stream that cannot open leaves the game running without it
+    if (config.streamPort > 0) {
+        stream = std::make_unique<SpectatorStream>();
+        std::string error;
+        if (!stream->Open(config.streamPort, error)) {
+            fprintf(stderr, "stream: %s\n", error.c_str());
+            stream.reset();
+        }
+    }
+}
+
+// The physics worlds depend on the size of the play area, so they are
+// created once the scene or snapshot has given it
+void Game::CreatePhysics() {
     // Create Box2D world with no gravity (top-down view)
     b2WorldDef worldDef = b2DefaultWorldDef();
     worldDef.gravity = {0.0f, 0.0f};
     worldDef.enableContinuous = true;  // Enable continuous collision
     worldDef.restitutionThreshold = 0.0f;  // Allow all collisions to bounce
-    worldId = b2CreateWorld(&worldDef);
     
-    // Create world bounds
-    CreateWorldBounds();
+    // Box2D's memory is counted with the game's own, which needs the
+    // allocator in place before the first world allocates anything
+    InstallBox2DAllocator();
+    
+    if (config.shardCount > 1) {
+        // Sharded, the workers step whole worlds rather than one world's solver
+        if (config.workerCount > 1) {
+            scheduler = std::make_unique<TaskScheduler>(config.workerCount);
+        }
+        shards = std::make_unique<ShardedWorld>(config.shardCount, worldWidth, worldDef, scheduler.get());
+        worldId = shards->World(0);
+    } else {
+        // Spread the solver across cores when more than one worker is requested
+        if (config.workerCount > 1) {
+            scheduler = std::make_unique<TaskScheduler>(config.workerCount);
+            scheduler->Attach(worldDef);
+        }
+        worldId = b2CreateWorld(&worldDef);
+    }
+    
+    // Every shard is walled in whole, its inner walls are simply never reached
+    for (int i = 0; i < WorldCount(); i++) {
+        CreateWorldBounds(World(i));
+    }
+}
+
+void Game::BuildScene(const Scene& scene) {
+    worldWidth = scene.width;
+    worldHeight = scene.height;
+    CreatePhysics();
     
-    // Create player
-    player = std::make_unique<Ball>(this, false);  // false = not auto-moving (player-controlled)
+    // Size the stores up front, large scenes would otherwise reallocate many times
+    entities.balls.Reserve((int)scene.balls.size());
+    entities.bricks.Reserve(scene.BrickCount());
+    walls.reserve(scene.walls.size());
     
-    // Create 5 enemies with random positions and predefined colors
-    Color enemyColors[] = { RED, BLUE, GREEN, YELLOW, ORANGE };
+    for (const Scene::Ball& ball : scene.balls) {
+        int index = entities.balls.Create(WorldAt(ball.x), random, ball.x, ball.y, ball.color, !ball.player);
+        if (ball.player && playerIndex < 0) playerIndex = index;
+    }
     
-    for (int i = 0; i < 5; i++) {
-        float x = 50 + (float)(GetRandomValue(0, (int)screenWidth - 100));
-        float y = 50 + (float)(GetRandomValue(0, (int)screenHeight - 100));
-        enemies.push_back(std::make_unique<Ball>(this, x, y, enemyColors[i]));
+    for (const Scene::Wall& wall : scene.walls) {
+        AddWall(wall.x, wall.y, wall.brickCount, wall.horizontal, wall.color);
     }
     
-    // Create 2 brick walls with random lengths
-    int wall1Length = GetRandomValue(8, 15);
-    int wall2Length = GetRandomValue(8, 15);
+    // Loose bricks are debris from the start
+    for (const Scene::Brick& brick : scene.bricks) {
+        debris->Track(entities.bricks.Create(WorldAt(brick.x), brick.x, brick.y, brick.color, false));
+    }
     
-    // Horizontal wall in middle-upper area
-    walls.push_back(std::make_unique<Wall>(this, 200.0f, 150.0f, wall1Length, true, BROWN));
+    for (const Scene::Light& light : scene.lights) {
+        if (light.type == LightType::Point) {
+            lights.emplace_back(light.vector, LightType::Point);
+        } else {
+            lights.emplace_back(light.vector);
+        }
+    }
     
-    // Vertical wall in middle-right area
-    walls.push_back(std::make_unique<Wall>(this, 600.0f, 250.0f, wall2Length, false, GRAY));
+    if (shards) shards->Populate(entities);
+    if (lightmap) lightmap->Reset(worldWidth, worldHeight, entities.bricks);
+}
+
+void Game::AddWall(float x, float y, int brickCount, bool horizontal, Color color) {
+    if (!shards || !horizontal) {
+        walls.emplace_back(entities.bricks, WorldAt(x), x, y, brickCount, horizontal, color);
+        return;
+    }
     
-    // Create HUD
-    hud = std::make_unique<Hud>(this);
+    // A wall crossing shard borders is built as one wall per shard it spans,
+    // each brick on the wall of the shard holding its centre
+    int first = 0;
+    while (first < brickCount) {
+        float startX = x + first * Wall::BRICK_SPACING;
+        int shard = shards->ShardAt(startX);
+        int count = brickCount - first;
+        if (shard + 1 < shards->Count()) {
+            float room = shards->ShardLeft(shard + 1) - startX;
+            count = std::clamp((int)ceilf(room / Wall::BRICK_SPACING), 1, count);
+        }
+        walls.emplace_back(entities.bricks, shards->World(shard), startX, y, count, true, color);
+        first += count;
+    }
+}
+
+void Game::RestoreSnapshot(const WorldSnapshot& snapshot) {
+    const SnapshotHeader& header = *snapshot.header;
+    worldWidth = header.worldWidth;
+    worldHeight = header.worldHeight;
+    stepCount = header.stepCount;
+    accumulator = header.accumulator;
+    interpolationAlpha = accumulator / FixedTimeStep();
+    random.State(header.randomState);
+    
+    CreatePhysics();
+    
+    entities.balls.Reserve((int)header.ballCount);
+    entities.bricks.Reserve((int)header.brickCount);
+    walls.reserve(header.wallCount);
+    
+    // Every record goes straight from the snapshot into a body definition,
+    // bricks keep their indices so walls and debris still refer to them
+    for (uint32_t i = 0; i < header.ballCount; i++) {
+        const BallState& ball = snapshot.balls[i];
+        int index = entities.balls.Restore(WorldAt(ball.position.x * PIXELS_PER_METER), ball);
+        if (entities.balls.IsPlayer(index) && playerIndex < 0) playerIndex = index;
+    }
+    
+    for (uint32_t i = 0; i < header.wallCount; i++) {
+        const WallState& wall = snapshot.walls[i];
+        walls.emplace_back(WorldAt(wall.position.x * PIXELS_PER_METER), wall.position, wall.firstBrick, wall.brickCount);
+    }
+    
+    // Walls of an unsharded snapshot may cross shard borders, bricks on the
+    // far side of one get a static body of their own in their shard
+    for (uint32_t i = 0; i < header.brickCount; i++) {
+        const BrickState& brick = snapshot.bricks[i];
+        b2WorldId brickWorldId = WorldAt(brick.position.x * PIXELS_PER_METER);
+        b2BodyId wallBodyId = b2_nullBodyId;
+        if (brick.wall >= 0) {
+            b2WorldId wallWorldId = b2Body_GetWorld(walls[brick.wall].GetBodyId());
+            if (SameWorld(wallWorldId, brickWorldId)) wallBodyId = walls[brick.wall].GetBodyId();
+        }
+        entities.bricks.Restore(brickWorldId, wallBodyId, brick);
+    }
+    
+    debris->Restore(snapshot.debris, (int)header.debrisCount, (int)header.frozenDebris, (int)header.culledDebris);
+    
+    for (uint32_t i = 0; i < header.lightCount; i++) {
+        const LightState& state = snapshot.lights[i];
+        if ((LightType)state.type == LightType::Point) {
+            lights.emplace_back(state.position, LightType::Point);
+        } else {
+            lights.emplace_back(state.direction);
+        }
+        lights.back().SetAttenuation(state.attenuation.x, state.attenuation.y, state.attenuation.z);
+    }
+    
+    if (shards) shards->Populate(entities);
+    if (lightmap) lightmap->Reset(worldWidth, worldHeight, entities.bricks);
+}
+
+bool Game::SaveSnapshot(const char* path) const {
+    SnapshotHeader header{};
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.version = SNAPSHOT_VERSION;
+    header.ballCount = (uint32_t)entities.balls.Count();
+    header.brickCount = (uint32_t)entities.bricks.Count();
+    header.wallCount = (uint32_t)walls.size();
+    header.lightCount = (uint32_t)lights.size();
+    header.debrisCount = (uint32_t)debris->ActiveCount();
+    header.frozenDebris = (uint32_t)debris->FrozenCount();
+    header.culledDebris = (uint32_t)debris->CulledCount();
+    header.stepCount = stepCount;
+    header.randomState = random.State();
+    header.worldWidth = worldWidth;
+    header.worldHeight = worldHeight;
+    header.accumulator = accumulator;
+    LayoutSnapshot(header);
+    
+    // Fill the whole file in memory, zeroed so padding bytes are always the same
+    std::vector<unsigned char> bytes((size_t)header.fileSize, 0);
+    memcpy(bytes.data(), &header, sizeof(header));
+    
+    BallState* balls = (BallState*)(bytes.data() + header.ballOffset);
+    for (int i = 0; i < entities.balls.Count(); i++) {
+        entities.balls.WriteState(i, balls[i]);
+    }
+    
+    // Walls own contiguous, ascending ranges of bricks, so one pass over the
+    // bricks finds the wall whose body still carries each one
+    BrickState* bricks = (BrickState*)(bytes.data() + header.brickOffset);
+    size_t wall = 0;
+    for (int i = 0; i < entities.bricks.Count(); i++) {
+        while (wall < walls.size() && i >= walls[wall].FirstBrick() + walls[wall].BrickCount()) wall++;
+        
+        bool onWall = wall < walls.size() && i >= walls[wall].FirstBrick()
+            && B2_ID_EQUALS(entities.bricks.GetBodyId(i), walls[wall].GetBodyId());
+        entities.bricks.WriteState(i, onWall ? (int)wall : -1, bricks[i]);
+    }
+    
+    WallState* wallStates = (WallState*)(bytes.data() + header.wallOffset);
+    for (size_t i = 0; i < walls.size(); i++) {
+        wallStates[i].position = b2Body_GetPosition(walls[i].GetBodyId());
+        wallStates[i].firstBrick = walls[i].FirstBrick();
+        wallStates[i].brickCount = walls[i].BrickCount();
+    }
     
-    // Create point light at center of screen
-    Vector2 lightPos = { screenWidth / 2.0f, screenHeight / 2.0f };
-    light = std::make_unique<FakeLight>(lightPos, LightType::Point);
+    LightState* lightStates = (LightState*)(bytes.data() + header.lightOffset);
+    for (size_t i = 0; i < lights.size(); i++) {
+        lightStates[i].type = (int32_t)lights[i].GetType();
+        lightStates[i].position = lights[i].GetPosition();
+        lightStates[i].direction = lights[i].GetDirection();
+        lightStates[i].attenuation = lights[i].GetAttenuation();
+    }
+    
+    debris->WriteState((DebrisState*)(bytes.data() + header.debrisOffset));
+    
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "snapshot: cannot write %s\n", path);
+        return false;
+    }
+    bool ok = fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+    ok = fclose(file) == 0 && ok;
+    if (!ok) fprintf(stderr, "snapshot: cannot write %s\n", path);
+    return ok;
 }
 
-void Game::CreateWorldBounds() {
-    // Create static walls around the screen (convert pixels to meters)
+void Game::CreateWorldBounds(b2WorldId boundsWorldId) {
+    // Create static walls around the play area (convert pixels to meters)
     b2BodyDef wallDef = b2DefaultBodyDef();
     wallDef.type = b2_staticBody;
     
@@ -58,106 +311,361 @@ void Game::CreateWorldBounds() {
     shapeDef.material.restitution = 0.8f;  // Bounciness
     
     float wallThickness = 10.0f / PIXELS_PER_METER;
-    float halfWidth = screenWidth / (2.0f * PIXELS_PER_METER);
-    float halfHeight = screenHeight / (2.0f * PIXELS_PER_METER);
+    float halfWidth = worldWidth / (2.0f * PIXELS_PER_METER);
+    float halfHeight = worldHeight / (2.0f * PIXELS_PER_METER);
     
     // Bottom wall
-    wallDef.position = {halfWidth, (screenHeight / PIXELS_PER_METER) + wallThickness};
-    wallBodies[0] = b2CreateBody(worldId, &wallDef);
+    wallDef.position = {halfWidth, (worldHeight / PIXELS_PER_METER) + wallThickness};
+    b2BodyId bottomBody = b2CreateBody(boundsWorldId, &wallDef);
     b2Polygon bottomBox = b2MakeBox(halfWidth, wallThickness);
-    b2CreatePolygonShape(wallBodies[0], &shapeDef, &bottomBox);
+    b2CreatePolygonShape(bottomBody, &shapeDef, &bottomBox);
     
     // Top wall
     wallDef.position = {halfWidth, -wallThickness};
-    wallBodies[1] = b2CreateBody(worldId, &wallDef);
+    b2BodyId topBody = b2CreateBody(boundsWorldId, &wallDef);
     b2Polygon topBox = b2MakeBox(halfWidth, wallThickness);
-    b2CreatePolygonShape(wallBodies[1], &shapeDef, &topBox);
+    b2CreatePolygonShape(topBody, &shapeDef, &topBox);
     
     // Left wall
     wallDef.position = {-wallThickness, halfHeight};
-    wallBodies[2] = b2CreateBody(worldId, &wallDef);
+    b2BodyId leftBody = b2CreateBody(boundsWorldId, &wallDef);
     b2Polygon leftBox = b2MakeBox(wallThickness, halfHeight);
-    b2CreatePolygonShape(wallBodies[2], &shapeDef, &leftBox);
+    b2CreatePolygonShape(leftBody, &shapeDef, &leftBox);
     
     // Right wall
-    wallDef.position = {(screenWidth / PIXELS_PER_METER) + wallThickness, halfHeight};
-    wallBodies[3] = b2CreateBody(worldId, &wallDef);
+    wallDef.position = {(worldWidth / PIXELS_PER_METER) + wallThickness, halfHeight};
+    b2BodyId rightBody = b2CreateBody(boundsWorldId, &wallDef);
     b2Polygon rightBox = b2MakeBox(wallThickness, halfHeight);
-    b2CreatePolygonShape(wallBodies[3], &shapeDef, &rightBox);
+    b2CreatePolygonShape(rightBody, &shapeDef, &rightBox);
 }
 
 Game::~Game() {
-    b2DestroyWorld(worldId);
+    // Sharded worlds go with their ShardedWorld
+    if (!shards) b2DestroyWorld(worldId);
 }
 
-void Game::Update() {
+void Game::Update(float frameTime) {
     if (exitRequested) running = false;
     
-    // Step the physics world with fixed timestep (Box2D v3 recommendation)
-    float timeStep = 1.0f / 60.0f;  // Fixed 60 FPS timestep
-    int subStepCount = 4;
-    b2World_Step(worldId, timeStep, subStepCount);
+    frameTimings.stepCount = 0;
+    {
+        ProfileScope scope(*profiler, ProfileZone::Update);
+        
+        // Run the physics at its own fixed rate regardless of the display rate
+        float timeStep = FixedTimeStep();
+        accumulator += frameTime;
+        
+        while (accumulator >= timeStep && frameTimings.stepCount < config.maxCatchUpSteps) {
+            Step();
+            accumulator -= timeStep;
+            frameTimings.stepCount++;
+        }
+        
+        // Drop whatever the catch-up cap left over instead of spiralling further behind
+        if (accumulator >= timeStep) {
+            accumulator = fmodf(accumulator, timeStep);
+        }
+        interpolationAlpha = accumulator / timeStep;
+    }
+    
+    // The profiler's running totals for this frame are the update's timings
+    frameTimings.stepMs = profiler->FrameMs(ProfileZone::Step);
+    frameTimings.breaksMs = profiler->FrameMs(ProfileZone::Breaks);
+    frameTimings.updateMs = profiler->FrameMs(ProfileZone::Update);
     
-    // Update all balls (sync from physics)
-    if (player) player->Update();
-    for (auto& enemy : enemies) {
-        if (enemy) enemy->Update();
+    // Frames without a step say nothing about what the physics costs
+    if (frameTimings.stepCount > 0) {
+        governor->Observe(frameTimings.updateMs);
     }
+}
+
+int Game::GovernedQuality() const {
+    return governor->Level();
+}
+
+void Game::ApplyQuality(int level) {
+    level = std::clamp(level, 0, QualityGovernor::LEVEL_COUNT - 1);
+    if (level == qualityLevel) return;
+    
+    PhysicsQuality full;
+    full.subStepCount = config.subStepCount;
+    full.debrisSettleSteps = (int)(config.debrisSettleTime * config.simRate);
+    full.maxActiveDebris = config.maxActiveDebris;
+    full.continuous = true;
     
-    // Update walls (check for breaks)
-    for (auto& wall : walls) {
-        if (wall) wall->Update();
+    PhysicsQuality quality = QualityGovernor::AtLevel(full, level);
+    qualityLevel = level;
+    subStepCount = quality.subStepCount;
+    debris->SetLimits(quality.debrisSettleSteps, quality.maxActiveDebris);
+    for (int i = 0; i < WorldCount(); i++) {
+        b2World_EnableContinuous(World(i), quality.continuous);
     }
 }
 
+void Game::Step() {
+    // Player input is a continuous force, so it applies to every step
+    if (playerIndex >= 0 && (playerInput.x != 0.0f || playerInput.y != 0.0f)) {
+        entities.balls.ApplyForce(playerIndex, playerInput.x, playerInput.y);
+    }
+    
+    {
+        ProfileScope scope(*profiler, ProfileZone::Step);
+        if (shards) {
+            shards->Step(FixedTimeStep(), subStepCount);
+        } else {
+            b2World_Step(worldId, FixedTimeStep(), subStepCount);
+        }
+    }
+    
+    // Shards add up, so their stages show the work done rather than the wait
+    for (int i = 0; i < WorldCount(); i++) {
+        profiler->AddBox2DProfile(b2World_GetProfile(World(i)));
+    }
+    stepCount++;
+    
+    // Box2D only reports bodies that moved, so resting bodies cost nothing here
+    for (int i = 0; i < WorldCount(); i++) {
+        entities.SyncMovedBodies(b2World_GetBodyEvents(World(i)), stepCount);
+    }
+    
+    // Break bricks that were hit during the step
+    {
+        ProfileScope scope(*profiler, ProfileZone::Breaks);
+        DispatchContactEvents();
+    }
+    
+    // Only now may bodies change worlds, the events above refer to their shapes
+    if (shards) {
+        ProfileScope scope(*profiler, ProfileZone::Shards);
+        shards->Exchange(entities);
+    }
+    
+    // Keep the amount of moving debris bounded
+    debris->Update(entities.bricks, stepCount);
+    
+    // Spectators see the step once it is complete, debris retirement included
+    if (stream) {
+        ProfileScope scope(*profiler, ProfileZone::Stream);
+        stream->Publish(entities, stepCount);
+    }
+}
+
+void Game::DispatchContactEvents() {
+    // Read the step's hit events once and route each one straight to the brick
+    // it involves through the shape user data, so the cost follows the number
+    // of hits instead of the number of walls and bricks in the level
+    for (int world = 0; world < WorldCount(); world++) {
+        DispatchContactEvents(b2World_GetContactEvents(World(world)));
+    }
+}
+
+void Game::DispatchContactEvents(const b2ContactEvents& events) {
+    for (int i = 0; i < events.hitCount; i++) {
+        const b2ContactHitEvent& hit = events.hitEvents[i];
+        
+        // Shapes may have been destroyed since the step produced the event
+        if (!b2Shape_IsValid(hit.shapeIdA) || !b2Shape_IsValid(hit.shapeIdB)) continue;
+        
+        int brickA = BrickStore::FromShape(hit.shapeIdA);
+        int brickB = BrickStore::FromShape(hit.shapeIdB);
+        
+        // Read both velocities first, breaking a brick replaces its shape
+        b2Vec2 velocityA = b2Body_GetLinearVelocity(b2Shape_GetBody(hit.shapeIdA));
+        b2Vec2 velocityB = b2Body_GetLinearVelocity(b2Shape_GetBody(hit.shapeIdB));
+        
+        // Break attached bricks using the velocity of the body that hit them
+        // A hit on a brick's ghost in a neighbouring shard breaks the brick itself
+        if (brickA >= 0 && entities.bricks.IsAttached(brickA)) {
+            if (lightmap) lightmap->RemoveOccluder(entities.bricks.GetTransform(brickA));
+            entities.bricks.Break(brickA, velocityB);
+            debris->Track(brickA);
+            if (shards) shards->BrickBroken(brickA);
+        }
+        if (brickB >= 0 && entities.bricks.IsAttached(brickB)) {
+            if (lightmap) lightmap->RemoveOccluder(entities.bricks.GetTransform(brickB));
+            entities.bricks.Break(brickB, velocityA);
+            debris->Track(brickB);
+            if (shards) shards->BrickBroken(brickB);
+        }
+    }
+}
+
+void Game::PrepareFrame() {
+    ProfileScope scope(*profiler, ProfileZone::Prepare);
+    RenderFrame& frame = *frames[1 - frontFrame];
+    
+    // Only the bodies Box2D finds under the camera are queued for drawing
+    CollectVisible();
+    frame.camera = camera->Get();
+    frame.worldWidth = worldWidth;
+    frame.worldHeight = worldHeight;
+    
+    // Queue the visible balls and light them all in one pass
+    frame.enemies.Clear();
+    entities.balls.AppendTo(frame.enemies, visible.balls, false, interpolationAlpha, stepCount);
+    frame.players.Clear();
+    entities.balls.AppendTo(frame.players, visible.balls, true, interpolationAlpha, stepCount);
+    {
+        // The lightmap only recomputes the cells whose shadows or lights
+        // changed, the unshadowed field rebins every light, which is cheap
+        ProfileScope lightingScope(*profiler, ProfileZone::Lighting);
+        if (lightmap) {
+            lightmap->Update(lights);
+            frame.enemies.Light(*lightmap);
+            frame.players.Light(*lightmap);
+        } else {
+            lightField->Build(lights, worldWidth, worldHeight);
+            frame.enemies.Light(*lightField);
+            frame.players.Light(*lightField);
+        }
+    }
+    
+    frame.bricks.Clear();
+    entities.bricks.AppendTo(frame.bricks, visible.bricks, interpolationAlpha, stepCount);
+    
+    frame.lights.assign(lights.begin(), lights.end());
+    b2Counters counters = WorldCounters();
+    frame.bodyCount = counters.bodyCount;
+    frame.contactCount = counters.contactCount;
+    frame.drawnCount = (int)(visible.balls.size() + visible.bricks.size());
+    frame.step = stepCount;
+    frame.qualityLevel = qualityLevel;
+    frame.subStepCount = subStepCount;
+    frame.inputTime = inputTime;
+}
+
 void Game::Render() {
+    const RenderFrame& frame = *frames[frontFrame];
     BeginDrawing();
     
     // Draw radial gradient background based on light position
-    if (light && light->GetType() == LightType::Point) {
-        Vector2 lightPos = light->GetPosition();
-        Color baseColor = GetBackgroundColor();
-        Color centerColor = ColorBrightness(baseColor, 0.3f);  // 30% brighter at center
-        Color edgeColor = ColorBrightness(baseColor, -0.4f);   // 40% darker at edges
+    {
+        ProfileScope scope(*profiler, ProfileZone::Background);
+        const FakeLight* light = frame.lights.empty() ? nullptr : &frame.lights.front();
+        float radius = sqrtf(frame.worldWidth * frame.worldWidth + frame.worldHeight * frame.worldHeight) / 2.0f;
+        background->Draw(light, GetBackgroundColor(), frame.camera, screenWidth, screenHeight, radius);
+    }
+    
+    {
+        ProfileScope scope(*profiler, ProfileZone::Entities);
+        BeginMode2D(frame.camera);
         
-        // Draw gradient using concentric circles
-        float maxRadius = sqrtf(screenWidth * screenWidth + screenHeight * screenHeight) / 2.0f;
-        int steps = 50;  // Number of gradient steps
+        // Render enemies, all in one instanced draw
+        enemyRenderer->Draw(frame.enemies);
         
-        for (int i = steps; i >= 0; i--) {
-            float t = (float)i / steps;  // t=1.0 at outer edge, t=0.0 at center
-            float radius = maxRadius * t;
-            
-            // Interpolate from center (bright) to edge (dark)
-            // When t=0 (center), use centerColor. When t=1 (edge), use edgeColor
-            Color stepColor = {
-                (unsigned char)(centerColor.r + (edgeColor.r - centerColor.r) * t),
-                (unsigned char)(centerColor.g + (edgeColor.g - centerColor.g) * t),
-                (unsigned char)(centerColor.b + (edgeColor.b - centerColor.b) * t),
-                255
-            };
-            
-            DrawCircleV(lightPos, radius, stepColor);
-        }
-    } else {
-        ClearBackground(GetBackgroundColor());
+        // Render walls, all bricks in a single batch
+        frame.bricks.Draw();
+        
+        // Render player on top of the bricks
+        playerRenderer->Draw(frame.players);
+        
+        EndMode2D();
     }
     
-    for (auto& enemy : enemies) {
-        if (enemy) enemy->Render();
+    // Render HUD
+    if (hud) {
+        ProfileScope scope(*profiler, ProfileZone::Hud);
+        hud->Render();
     }
     
-    // Render walls
-    for (auto& wall : walls) {
-        if (wall) wall->Render();
+    // Includes waiting for the buffer swap, so vsync time shows up here
+    {
+        ProfileScope scope(*profiler, ProfileZone::Present);
+        presentStart = Profiler::Clock::now();
+        EndDrawing();
     }
     
-    if (player) player->Render();
+    // The first frame of a pipeline is drawn before any input was applied
+    if (frame.inputTime != Profiler::Clock::time_point()) {
+        profiler->Record(ProfileZone::Latency, frame.inputTime, Profiler::Clock::now());
+    }
+}
+
+void Game::CollectVisible() {
+    // Query Box2D's broadphase with the camera's view (convert pixels to meters)
+    Rectangle area = camera->VisibleArea();
+    b2AABB bounds;
+    bounds.lowerBound = {
+        (area.x - CULL_MARGIN) / PIXELS_PER_METER,
+        (area.y - CULL_MARGIN) / PIXELS_PER_METER
+    };
+    bounds.upperBound = {
+        (area.x + area.width + CULL_MARGIN) / PIXELS_PER_METER,
+        (area.y + area.height + CULL_MARGIN) / PIXELS_PER_METER
+    };
+    visible.Clear();
+    for (int i = 0; i < WorldCount(); i++) {
+        visible.Add(World(i), bounds);
+    }
+}
+
+int Game::WorkerCount() const {
+    return scheduler ? scheduler->WorkerCount() : 1;
+}
+
+int Game::ShardCount() const {
+    return shards ? shards->Count() : 1;
+}
+
+int Game::WorldCount() const {
+    return shards ? shards->Count() : 1;
+}
+
+b2WorldId Game::World(int index) const {
+    return shards ? shards->World(index) : worldId;
+}
+
+b2WorldId Game::WorldAt(float x) const {
+    return shards ? shards->WorldAt(x) : worldId;
+}
+
+b2Counters Game::WorldCounters() const {
+    b2Counters total = b2World_GetCounters(World(0));
+    for (int i = 1; i < WorldCount(); i++) {
+        b2Counters counters = b2World_GetCounters(World(i));
+        total.bodyCount += counters.bodyCount;
+        total.shapeCount += counters.shapeCount;
+        total.contactCount += counters.contactCount;
+        total.jointCount += counters.jointCount;
+        total.islandCount += counters.islandCount;
+    }
+    return total;
+}
+
+// FNV-1a over the raw bytes of a value
+template <typename T>
+static void HashValue(uint64_t& hash, const T& value) {
+    const unsigned char* bytes = (const unsigned char*)&value;
+    for (size_t i = 0; i < sizeof(T); i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+}
+
+uint64_t Game::StateHash() const {
+    uint64_t hash = 14695981039346656037ULL;
+    HashValue(hash, stepCount);
     
-    // Render HUD
-    if (hud) hud->Render();
+    for (int i = 0; i < entities.balls.Count(); i++) {
+        b2BodyId bodyId = entities.balls.GetBodyId(i);
+        HashValue(hash, b2Body_GetTransform(bodyId));
+        HashValue(hash, b2Body_GetLinearVelocity(bodyId));
+    }
     
-    EndDrawing();
+    // Culled bricks have given their body to another brick, only their state counts
+    for (int i = 0; i < entities.bricks.Count(); i++) {
+        uint8_t state = (uint8_t)((entities.bricks.IsAttached(i) ? 1 : 0)
+            | (entities.bricks.IsFrozen(i) ? 2 : 0)
+            | (entities.bricks.IsCulled(i) ? 4 : 0));
+        HashValue(hash, state);
+        if (entities.bricks.IsCulled(i)) continue;
+        
+        b2BodyId bodyId = entities.bricks.GetBodyId(i);
+        HashValue(hash, b2Body_GetTransform(bodyId));
+        HashValue(hash, b2Body_GetLinearVelocity(bodyId));
+    }
+    
+    return hash;
 }
 
 bool Game::IsRunning() const {
@@ -204,31 +712,73 @@ void Game::ScreenHeight(float value) {
     screenHeight = value;
 }
 
-void Game::ProcessInput() {
-    if (exitRequested || IsKeyPressed(KEY_ESCAPE)) {
+uint8_t Game::PollInput() {
+    ProfileScope scope(*profiler, ProfileZone::Input);
+    
+    // F3 shows the profiler panel, F4 captures the next frames as a Chrome trace
+    // and F5 saves a snapshot of the world that --snapshot resumes
+    // None of them affects the simulation, so they are not part of the recorded input
+    if (IsKeyPressed(KEY_F3)) {
+        hud->ToggleProfiler();
+    }
+    if (IsKeyPressed(KEY_F4) && !profiler->IsCapturing()) {
+        profiler->BeginCapture("raycode_trace.json", TRACE_FRAMES);
+    }
+    if (IsKeyPressed(KEY_F5)) {
+        SaveSnapshot("raycode_snapshot.rcs");
+    }
+    
+    // The camera only changes what is drawn, so it is not recorded either
+    // Mouse wheel zooms around the cursor, right drag pans, Home shows the whole world
+    float wheel = GetMouseWheelMove();
+    if (wheel != 0.0f) {
+        camera->ZoomAt(GetMousePosition(), powf(1.1f, wheel));
+    }
+    if (IsMouseButtonDown(MOUSE_BUTTON_RIGHT)) {
+        camera->Pan(GetMouseDelta());
+    }
+    if (IsKeyPressed(KEY_HOME)) {
+        camera->FitWorld(worldWidth, worldHeight);
+    }
+    
+    return PollButtons();
+}
+
+uint8_t Game::PollButtons() const {
+    uint8_t buttons = 0;
+    if (IsKeyPressed(KEY_ESCAPE)) buttons |= INPUT_EXIT;
+    if (IsKeyDown(KEY_LEFT)) buttons |= INPUT_LEFT;
+    if (IsKeyDown(KEY_RIGHT)) buttons |= INPUT_RIGHT;
+    if (IsKeyDown(KEY_UP)) buttons |= INPUT_UP;
+    if (IsKeyDown(KEY_DOWN)) buttons |= INPUT_DOWN;
+    
+    return buttons;
+}
+
+void Game::ApplyInput(uint8_t buttons) {
+    inputTime = Profiler::Clock::now();
+    
+    if (buttons & INPUT_EXIT) {
         RequestExit();
         return;
     }
-
-    if (!player) return;
     
     float forceX = 0.0f;
     float forceY = 0.0f;
     
-    if (IsKeyDown(KEY_LEFT)) {
+    if (buttons & INPUT_LEFT) {
         forceX -= 1.0f;
     }
-    if (IsKeyDown(KEY_RIGHT)) {
+    if (buttons & INPUT_RIGHT) {
         forceX += 1.0f;
     }
-    if (IsKeyDown(KEY_UP)) {
+    if (buttons & INPUT_UP) {
         forceY -= 1.0f;
     }
-    if (IsKeyDown(KEY_DOWN)) {
+    if (buttons & INPUT_DOWN) {
         forceY += 1.0f;
     }
     
-    if (forceX != 0.0f || forceY != 0.0f) {
-        player->ApplyForce(forceX, forceY);
-    }
+    // Applied on every physics step until the next poll
+    playerInput = { forceX, forceY };
 }
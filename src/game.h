@@ -1,22 +1,97 @@
 #pragma once
 
 #include <raylib.h>
+#include <chrono>
+#include <cstdint>
 #include <memory>
 #include <vector>
 #include <box2d/box2d.h>
+#include "entity_store.h"
+#include "wall.h"
+#include "FakeLight.h"
+#include "random.h"
 
-class Ball;
-class Wall;
 class Hud;
-class FakeLight;
+class Profiler;
+struct Scene;
+struct WorldSnapshot;
+class TaskScheduler;
+struct RenderFrame;
+class Background;
+class BallRenderer;
+class DebrisManager;
+class GameCamera;
+class LightField;
+class Lightmap;
+class ShardedWorld;
+class QualityGovernor;
+class SpectatorStream;
+
+// Settings fixed for the lifetime of a Game
+struct GameConfig {
+    unsigned int seed = 1;    // Seeds the game's random stream, the same seed builds the same world
+    int workerCount = 1;      // Threads used by b2World_Step, including the game thread
+    int shardCount = 1;       // Box2D worlds the play area is split across, see ShardedWorld
+    float simRate = 60.0f;    // Fixed physics steps per second
+    int subStepCount = 4;     // Box2D substeps per physics step
+    int maxCatchUpSteps = 5;  // Most physics steps run by one Update before time is dropped
+    
+    float debrisSettleTime = 2.0f;  // Seconds broken bricks must rest before they are retired
+    int maxActiveDebris = 256;      // Moving broken bricks allowed before the oldest is retired
+    bool cullDebris = false;        // Retire debris by removing it rather than freezing it
+    
+    // Update time a frame may take before physics quality is lowered, see
+    // QualityGovernor; 0 always simulates at full quality
+    float frameBudgetMs = 0.0f;
+    
+    // Light the balls from a Lightmap, with the shadows of the walls, rather
+    // than from an unshadowed LightField
+    bool shadows = true;
+    
+    // Local UDP port to stream the world state to once per step, see
+    // SpectatorStream; 0 streams nothing
+    int streamPort = 0;
+};
+
+// Wall-clock cost of the phases of the last Game::Update, in milliseconds
+struct FrameTimings {
+    double stepMs = 0.0;    // b2World_Step, summed over the frame's physics steps
+    double breaksMs = 0.0;  // Brick break detection
+    double updateMs = 0.0;  // The whole update
+    int stepCount = 0;      // Physics steps run by the update
+};
 
 class Game {
 public:
-    Game();
+    // Build the default arena
+    Game(const GameConfig& config = GameConfig());
+    
+    // Build the world described by a scene
+    Game(const GameConfig& config, const Scene& scene);
+    
+    // Resume the world captured in a snapshot, the config's seed is ignored
+    // in favour of the snapshot's random state
+    Game(const GameConfig& config, const WorldSnapshot& snapshot);
     ~Game();
 
-    void Update();
+    // Advance the simulation by frameTime seconds of real time, running as
+    // many fixed physics steps as have accumulated (up to the catch-up cap)
+    void Update(float frameTime);
+    
+    // Copy what the camera sees of the simulation into the back frame,
+    // reading the world but never drawing
+    void PrepareFrame();
+    
+    // Make the frame prepared last the one Render draws
+    void SwapFrames() { frontFrame = 1 - frontFrame; }
+    
+    // Draw the front frame, touching neither the world nor the entity stores,
+    // so it may run while another thread steps the simulation
+    // The caller closes the profiler frame
     void Render();
+    
+    // The frame Render draws
+    const RenderFrame& DrawnFrame() const { return *frames[frontFrame]; }
     bool IsRunning() const;
 
     float GameTime() const;
@@ -29,28 +104,154 @@ public:
     void ScreenWidth(float value);
     float ScreenHeight() const;
     void ScreenHeight(float value);
-    void ProcessInput();
+    float WorldWidth() const { return worldWidth; }
+    float WorldHeight() const { return worldHeight; }
+    
+    // Poll the keyboard and mouse, handle the camera and tool keys and return
+    // the buttons that drive the simulation as InputButton bits
+    // Presses, wheel and drag are those since the previous event poll, so it
+    // is called again after every extra PollInputEvents to lose none of them
+    // Must be called while the simulation is not running on another thread
+    uint8_t PollInput();
+    
+    // Apply one frame's InputButton bits, either polled or replayed
+    // Input latency is measured from here
+    void ApplyInput(uint8_t buttons);
+    
+    // When ApplyInput was last called
+    std::chrono::steady_clock::time_point InputTime() const { return inputTime; }
+    
+    // When Render last started EndDrawing, before the buffer swap
+    std::chrono::steady_clock::time_point PresentStart() const { return presentStart; }
     
+    // Physics quality level the governor recommends for the next frame,
+    // 0 (full) unless a frame budget is configured
+    int GovernedQuality() const;
+    
+    // Run the next frames at a quality level, either governed or replayed
+    void ApplyQuality(int level);
+    int QualityLevel() const { return qualityLevel; }
+    int SubStepCount() const { return subStepCount; }
+    const QualityGovernor& GetGovernor() const { return *governor; }
+    
+    // The physics world, the leftmost shard's in a sharded game
     b2WorldId GetWorldId() const { return worldId; }
-    FakeLight* GetLight() const { return light.get(); }
+    
+    // Body, shape, contact, joint and island counts of every world, ghosts included
+    b2Counters WorldCounters() const;
+    
+    // The shards of a sharded game, or nullptr
+    const ShardedWorld* GetShards() const { return shards.get(); }
+    
+    // The first light of the scene, or nullptr if it has none
+    FakeLight* GetLight() { return lights.empty() ? nullptr : &lights.front(); }
+    const FakeLight* GetLight() const { return lights.empty() ? nullptr : &lights.front(); }
+    std::vector<FakeLight>& GetLights() { return lights; }
+    const std::vector<FakeLight>& GetLights() const { return lights; }
+
+    // The spectator stream, or nullptr when not streaming
+    const SpectatorStream* GetStream() const { return stream.get(); }
+    
+    // The shadowed lighting of the play area, or nullptr without shadows
+    const Lightmap* GetLightmap() const { return lightmap.get(); }
+
+    const DebrisManager& GetDebris() const { return *debris; }
+    const GameCamera& GetCamera() const { return *camera; }
+    EntityStore& GetEntities() { return entities; }
+    const EntityStore& GetEntities() const { return entities; }
+    const FrameTimings& LastFrameTimings() const { return frameTimings; }
+    Profiler& GetProfiler() { return *profiler; }
+    const Profiler& GetProfiler() const { return *profiler; }
+    int WorkerCount() const;
+    int ShardCount() const;
+    
+    // Hash of every body's transform and velocity and every brick's state,
+    // equal between two runs only if they simulated exactly the same world
+    uint64_t StateHash() const;
+    
+    // Write every body, brick, light and the debris being tracked to a
+    // snapshot file that a Game can be restored from
+    bool SaveSnapshot(const char* path) const;
+    
+    Random& GetRandom() { return random; }
+    
+    float FixedTimeStep() const { return 1.0f / config.simRate; }
+    uint64_t StepCount() const { return stepCount; }
+    
+    // Fraction of a physics step between the last step and the render time,
+    // used to interpolate body transforms
+    float InterpolationAlpha() const { return interpolationAlpha; }
     
     // Box2D works best with meter-based units (0.1 to 10 meters)
     // Scale factor: 1 meter = 50 pixels
     static constexpr float PIXELS_PER_METER = 50.0f;
+    
+    // Frames written to the trace file when a capture is started with F4
+    static constexpr int TRACE_FRAMES = 300;
+    
+    // Padding around the camera's view when collecting visible bodies, in
+    // pixels, so bodies drawn between physics steps are not cut off early
+    static constexpr float CULL_MARGIN = 20.0f;
 
 private:
+    GameConfig config;
+    Random random;
     bool running;
     bool exitRequested = false;
     int targetFps = 60;
     float screenWidth = 800;
     float screenHeight = 600;
+    float worldWidth = 800;   // Walled play area, may be larger than the screen
+    float worldHeight = 600;
+    std::unique_ptr<TaskScheduler> scheduler;
+    std::unique_ptr<ShardedWorld> shards;  // Owns the worlds when sharded
     b2WorldId worldId;
-    b2BodyId wallBodies[4];  // Top, bottom, left, right walls
-    std::unique_ptr<Ball> player;
-    std::vector<std::unique_ptr<Ball>> enemies;
-    std::vector<std::unique_ptr<Wall>> walls;
+    EntityStore entities;
+    int playerIndex = -1;  // Index of the player in entities.balls
+    std::vector<Wall> walls;
+    std::unique_ptr<DebrisManager> debris;
+    std::unique_ptr<Background> background;
+    std::unique_ptr<RenderFrame> frames[2];  // Drawn and being prepared
+    int frontFrame = 0;
+    std::unique_ptr<BallRenderer> enemyRenderer;
+    std::unique_ptr<BallRenderer> playerRenderer;  // Separate so the player draws over the bricks
+    std::unique_ptr<LightField> lightField;
+    std::unique_ptr<Lightmap> lightmap;  // Replaces lightField when shadows are on
+    std::unique_ptr<GameCamera> camera;
+    VisibleEntities visible;
     std::unique_ptr<Hud> hud;
-    std::unique_ptr<FakeLight> light;
+    std::unique_ptr<Profiler> profiler;
+    std::unique_ptr<QualityGovernor> governor;
+    std::unique_ptr<SpectatorStream> stream;
+    int qualityLevel = 0;
+    int subStepCount = 4;  // Of the current quality level
+    std::vector<FakeLight> lights;
+    FrameTimings frameTimings;
+    float accumulator = 0.0f;
+    float interpolationAlpha = 0.0f;
+    uint64_t stepCount = 0;
+    Vector2 playerInput = { 0.0f, 0.0f };  // Held until the next input poll
+    std::chrono::steady_clock::time_point inputTime;
+    std::chrono::steady_clock::time_point presentStart;
+    
+    void CreateWorld();
+    void CreatePhysics();
+    void BuildScene(const Scene& scene);
+    void RestoreSnapshot(const WorldSnapshot& snapshot);
+    void CreateWorldBounds(b2WorldId boundsWorldId);
+    void AddWall(float x, float y, int brickCount, bool horizontal, Color color);
+    
+    // Every physics world, one unless the game is sharded
+    int WorldCount() const;
+    b2WorldId World(int index) const;
+    
+    // World simulating the point x pixels from the left of the play area
+    b2WorldId WorldAt(float x) const;
+    void Step();
+    void DispatchContactEvents();
+    void DispatchContactEvents(const b2ContactEvents& events);
+    void CollectVisible();
     
-    void CreateWorldBounds();
+    // The InputButton bits of the keyboard as last polled
+    uint8_t PollButtons() const;
 };
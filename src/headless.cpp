@@ -0,0 +1,472 @@
+#include "headless.h"
+#include "stats.h"
+#include "debris.h"
+#include "scene.h"
+#include "profiler.h"
+#include "input_recording.h"
+#include "snapshot.h"
+#include "memory.h"
+#include "sharded_world.h"
+#include "quality_governor.h"
+#include "lightmap.h"
+#include "spectator_stream.h"
+#include <raylib.h>
+#include <box2d/box2d.h>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+static constexpr int BOX2D_ZONE_COUNT = Profiler::ZONE_COUNT - (int)ProfileZone::B2Pairs;
+
+// Timing results of one headless run
+struct HeadlessRun {
+    int workerCount = 1;
+    int shardCount = 1;
+    int ghostCount = 0;      // Ghosts alive at the end of a sharded run
+    int migrationCount = 0;  // Bodies moved between shards during it
+    int ballCount = 0;
+    int brickCount = 0;
+    int lightCount = 0;
+    int bodyCount = 0;
+    int contactCount = 0;
+    int activeDebris = 0;
+    int frozenDebris = 0;
+    int culledDebris = 0;
+    int framesRun = 0;
+    uint64_t stateHash = 0;
+    double restoreMs = 0.0;  // Building the world from a snapshot
+    SampleSummary step;
+    SampleSummary breaks;
+    SampleSummary update;
+    SampleSummary shards;        // Only filled in when sharded
+    SampleSummary stream;        // Only filled in when streaming
+    SampleSummary prepare;       // Only filled in when frames are prepared
+    SampleSummary lighting;      // Likewise, the part of prepare spent lighting
+    SampleSummary inputLatency;  // Input applied to the end of the update that consumed it
+    SampleSummary box2d[BOX2D_ZONE_COUNT];  // Box2D's own stage breakdown
+    
+    // Per system: usage at the end of the run with peaks since it started,
+    // allocations made by its frames and by the second half of them
+    MemoryCounters memory[MEMORY_SYSTEM_COUNT];
+    int64_t frameAllocations[MEMORY_SYSTEM_COUNT] = {};
+    int64_t steadyAllocations[MEMORY_SYSTEM_COUNT] = {};
+    int allocatingFrames = 0;  // Frames of the second half that allocated at all
+    
+    // Frames run at each physics quality level
+    int qualityFrames[QualityGovernor::LEVEL_COUNT] = {};
+    
+    // Lightmap cells, those behind a brick and those recomputed over the run,
+    // the first full build included; only with shadows and prepared frames
+    bool lightmap = false;
+    int lightmapCells = 0;
+    int occludedCells = 0;
+    int64_t updatedCells = 0;
+    
+    // Spectator stream traffic, when streaming
+    bool streaming = false;
+    int streamSnapshots = 0;
+    int streamKeyframes = 0;
+    int64_t streamPackets = 0;
+    int64_t streamBytes = 0;
+    int64_t streamEntries = 0;
+    int64_t streamDropped = 0;
+    uint32_t streamSequence = 0;  // Last snapshot sent and its hash
+    uint64_t streamHash = 0;
+};
+
+// Run one session resumed from the snapshot, on the given scene, or on the
+// default arena when both are nullptr
+// A recording, when given, supplies the time and input of every frame
+// A trace is only captured and a snapshot only saved when their paths are not empty
+static HeadlessRun RunOnce(const HeadlessOptions& options, const Scene* scene, const WorldSnapshot* snapshot,
+                           int workerCount, const InputRecording* recording,
+                           const std::string& tracePath, const std::string& saveSnapshotPath) {
+    GameConfig config = options.config;
+    config.workerCount = workerCount;
+    
+    // Peaks are process-wide, restart them so each run reports its own
+    ResetMemoryPeaks();
+    
+    Profiler::Clock::time_point buildStart = Profiler::Clock::now();
+    std::unique_ptr<Game> game;
+    if (snapshot) {
+        game = std::make_unique<Game>(config, *snapshot);
+    } else if (scene) {
+        game = std::make_unique<Game>(config, *scene);
+    } else {
+        game = std::make_unique<Game>(config);
+    }
+    double buildMs = std::chrono::duration<double, std::milli>(Profiler::Clock::now() - buildStart).count();
+    
+    std::vector<double> stepSamples;
+    std::vector<double> breaksSamples;
+    std::vector<double> updateSamples;
+    std::vector<double> shardSamples;
+    std::vector<double> streamSamples;
+    std::vector<double> prepareSamples;
+    std::vector<double> lightingSamples;
+    std::vector<double> latencySamples;
+    stepSamples.reserve(options.frames);
+    breaksSamples.reserve(options.frames);
+    updateSamples.reserve(options.frames);
+    shardSamples.reserve(game->GetShards() ? options.frames : 0);
+    streamSamples.reserve(game->GetStream() ? options.frames : 0);
+    prepareSamples.reserve(options.prepareFrames ? options.frames : 0);
+    lightingSamples.reserve(options.prepareFrames ? options.frames : 0);
+    latencySamples.reserve(options.frames);
+    std::vector<double> box2dSamples[BOX2D_ZONE_COUNT];
+    for (std::vector<double>& samples : box2dSamples) {
+        samples.reserve(options.frames);
+    }
+    
+    Profiler& profiler = game->GetProfiler();
+    if (!tracePath.empty()) {
+        profiler.BeginCapture(tracePath, options.traceFrames);
+    }
+    
+    // Without a recording, feed exactly one fixed step of time per frame so
+    // every frame runs one physics step
+    float fixedFrameTime = game->FixedTimeStep();
+    int frame = 0;
+    
+    // The first half of the frames lets debris, contacts and arrays grow,
+    // the second half is expected to run without allocating
+    int steadyFrom = options.frames / 2;
+    HeadlessRun run;
+    int64_t startAllocations[MEMORY_SYSTEM_COUNT];
+    int64_t steadyAllocations[MEMORY_SYSTEM_COUNT];
+    for (int i = 0; i < MEMORY_SYSTEM_COUNT; i++) {
+        startAllocations[i] = ReadMemory((MemorySystem)i).allocations;
+        steadyAllocations[i] = startAllocations[i];
+    }
+    
+    while (frame < options.frames && game->IsRunning()) {
+        // Frames without a recording apply no buttons, but still time their input
+        float frameTime = fixedFrameTime;
+        uint8_t buttons = 0;
+        int quality = game->GovernedQuality();
+        if (recording) {
+            const FrameInput& input = recording->frames[frame];
+            buttons = input.buttons;
+            frameTime = input.frameTime;
+            quality = input.quality;
+        }
+        game->ApplyQuality(quality);
+        run.qualityFrames[game->QualityLevel()]++;
+        game->ApplyInput(buttons);
+        game->Update(frameTime);
+        frame++;
+        
+        // Without a window nothing is drawn, the input is done once the update consumed it
+        profiler.Record(ProfileZone::Latency, game->InputTime(), Profiler::Clock::now());
+        
+        if (options.prepareFrames) {
+            game->PrepareFrame();
+            game->SwapFrames();
+        }
+        
+        const FrameTimings& timings = game->LastFrameTimings();
+        stepSamples.push_back(timings.stepMs);
+        breaksSamples.push_back(timings.breaksMs);
+        updateSamples.push_back(timings.updateMs);
+        
+        // Without a window there is no frame pipeline to close the frame
+        profiler.EndFrame();
+        latencySamples.push_back(profiler.LastFrameMs(ProfileZone::Latency));
+        if (game->GetShards()) {
+            shardSamples.push_back(profiler.LastFrameMs(ProfileZone::Shards));
+        }
+        if (game->GetStream()) {
+            streamSamples.push_back(profiler.LastFrameMs(ProfileZone::Stream));
+        }
+        if (options.prepareFrames) {
+            prepareSamples.push_back(profiler.LastFrameMs(ProfileZone::Prepare));
+            lightingSamples.push_back(profiler.LastFrameMs(ProfileZone::Lighting));
+        }
+        for (int i = 0; i < BOX2D_ZONE_COUNT; i++) {
+            box2dSamples[i].push_back(profiler.LastFrameMs((ProfileZone)((int)ProfileZone::B2Pairs + i)));
+        }
+        
+        if (frame == steadyFrom) {
+            for (int i = 0; i < MEMORY_SYSTEM_COUNT; i++) {
+                steadyAllocations[i] = ReadMemory((MemorySystem)i).allocations;
+            }
+        } else if (frame > steadyFrom) {
+            for (int i = 0; i < MEMORY_SYSTEM_COUNT; i++) {
+                if (profiler.FrameAllocations((MemorySystem)i) > 0) {
+                    run.allocatingFrames++;
+                    break;
+                }
+            }
+        }
+    }
+    
+    // Read before saving, writing the snapshot allocates on its own
+    for (int i = 0; i < MEMORY_SYSTEM_COUNT; i++) {
+        run.memory[i] = ReadMemory((MemorySystem)i);
+        run.frameAllocations[i] = run.memory[i].allocations - startAllocations[i];
+        run.steadyAllocations[i] = frame > steadyFrom ? run.memory[i].allocations - steadyAllocations[i] : 0;
+    }
+    
+    if (!saveSnapshotPath.empty()) {
+        game->SaveSnapshot(saveSnapshotPath.c_str());
+    }
+    
+    b2Counters counters = game->WorldCounters();
+    
+    run.restoreMs = snapshot ? buildMs : 0.0;
+    run.workerCount = game->WorkerCount();
+    run.shardCount = game->ShardCount();
+    if (const ShardedWorld* shards = game->GetShards()) {
+        run.ghostCount = shards->GhostCount();
+        run.migrationCount = shards->MigrationCount();
+    }
+    run.framesRun = frame;
+    run.stateHash = game->StateHash();
+    run.ballCount = game->GetEntities().balls.Count();
+    run.brickCount = game->GetEntities().bricks.Count();
+    run.lightCount = (int)game->GetLights().size();
+    run.bodyCount = counters.bodyCount;
+    run.contactCount = counters.contactCount;
+    run.activeDebris = game->GetDebris().ActiveCount();
+    run.frozenDebris = game->GetDebris().FrozenCount();
+    run.culledDebris = game->GetDebris().CulledCount();
+    if (const SpectatorStream* stream = game->GetStream()) {
+        run.streaming = true;
+        run.streamSnapshots = stream->SnapshotCount();
+        run.streamKeyframes = stream->KeyframeCount();
+        run.streamPackets = stream->SentPackets();
+        run.streamBytes = stream->SentBytes();
+        run.streamEntries = stream->SentEntries();
+        run.streamDropped = stream->DroppedPackets();
+        run.streamSequence = stream->SentSequence();
+        run.streamHash = stream->SentHash();
+    }
+    if (const Lightmap* lightmap = game->GetLightmap(); lightmap && options.prepareFrames) {
+        run.lightmap = true;
+        run.lightmapCells = lightmap->CellCount();
+        run.occludedCells = lightmap->OccludedCellCount();
+        run.updatedCells = lightmap->UpdatedCells();
+    }
+    run.step = Summarize(std::move(stepSamples));
+    run.breaks = Summarize(std::move(breaksSamples));
+    run.update = Summarize(std::move(updateSamples));
+    run.shards = Summarize(std::move(shardSamples));
+    run.stream = Summarize(std::move(streamSamples));
+    run.prepare = Summarize(std::move(prepareSamples));
+    run.lighting = Summarize(std::move(lightingSamples));
+    run.inputLatency = Summarize(std::move(latencySamples));
+    for (int i = 0; i < BOX2D_ZONE_COUNT; i++) {
+        run.box2d[i] = Summarize(std::move(box2dSamples[i]));
+    }
+    return run;
+}
+
+static void PrintSummary(const char* name, const SampleSummary& summary, bool last) {
+    printf("        \"%s\": {\"mean\": %.6f, \"p50\": %.6f, \"p99\": %.6f, \"min\": %.6f, \"max\": %.6f}%s\n",
+        name, summary.mean, summary.p50, summary.p99, summary.min, summary.max,
+        last ? "" : ",");
+}
+
+// Text as the contents of a JSON string, for printing paths
+static std::string EscapeJson(const std::string& text) {
+    std::string escaped;
+    escaped.reserve(text.size());
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if ((unsigned char)c < 0x20) {
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", (unsigned)c);
+            escaped += code;
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+int RunHeadless(const HeadlessOptions& commandLine) {
+    HeadlessOptions options = commandLine;
+    
+    // A replay rebuilds the recorded world and runs its frames, only the
+    // worker counts still come from the command line
+    InputRecording recording;
+    bool replaying = !options.replayPath.empty();
+    if (replaying) {
+        std::string error;
+        if (!LoadInputRecording(options.replayPath.c_str(), recording, error)) {
+            fprintf(stderr, "headless: %s\n", error.c_str());
+            return 1;
+        }
+        options.config = recording.config;
+        
+        // Settings that leave the simulation alone still come from the command line
+        options.config.shadows = commandLine.config.shadows;
+        options.config.streamPort = commandLine.config.streamPort;
+        options.scene = recording.scene;
+        options.entityCount = recording.entityCount;
+        options.frames = (int)recording.frames.size();
+    }
+    
+    if (options.frames <= 0) {
+        fprintf(stderr, "headless: frame count must be positive\n");
+        return 1;
+    }
+    if (options.workerCounts.empty()) {
+        fprintf(stderr, "headless: at least one worker count is required\n");
+        return 1;
+    }
+    
+    // A snapshot stays mapped for every run, each one restores straight from it
+    MappedFile snapshotFile;
+    WorldSnapshot snapshot;
+    bool resuming = !options.snapshotPath.empty();
+    if (resuming) {
+        std::string error;
+        if (replaying) {
+            fprintf(stderr, "headless: a replay cannot start from a snapshot\n");
+            return 1;
+        }
+        if (!snapshotFile.Open(options.snapshotPath.c_str(), error)
+            || !ViewSnapshot(snapshotFile.Data(), snapshotFile.Size(), snapshot, error)) {
+            fprintf(stderr, "headless: %s\n", error.c_str());
+            return 1;
+        }
+        options.scene.clear();
+    }
+    
+    // Presets place entities randomly, from their own stream of the same seed
+    Random sceneRandom(options.config.seed);
+    Scene scene;
+    if (!options.scene.empty()) {
+        std::string error;
+        if (!ResolveScene(options.scene, options.entityCount, sceneRandom, scene, error)) {
+            fprintf(stderr, "headless: %s\n", error.c_str());
+            return 1;
+        }
+    }
+    
+    std::vector<HeadlessRun> runs;
+    // Only the first run is traced and saved, later runs would overwrite the same files
+    for (size_t i = 0; i < options.workerCounts.size(); i++) {
+        runs.push_back(RunOnce(options, options.scene.empty() ? nullptr : &scene,
+            resuming ? &snapshot : nullptr, options.workerCounts[i], replaying ? &recording : nullptr,
+            i == 0 ? options.tracePath : std::string(),
+            i == 0 ? options.saveSnapshotPath : std::string()));
+    }
+    
+    // Timings are reported in milliseconds, speedups against the first run's mean step
+    double baselineStep = runs.front().step.mean;
+    
+    printf("{\n");
+    printf("  \"mode\": \"headless\",\n");
+    printf("  \"seed\": %u,\n", options.config.seed);
+    printf("  \"frames\": %d,\n", options.frames);
+    printf("  \"simRate\": %.3f,\n", options.config.simRate);
+    if (resuming) {
+        printf("  \"snapshot\": \"%s\",\n", EscapeJson(options.snapshotPath).c_str());
+    } else {
+        printf("  \"scene\": \"%s\",\n", options.scene.empty() ? "default" : EscapeJson(options.scene).c_str());
+    }
+    printf("  \"balls\": %d,\n", runs.front().ballCount);
+    printf("  \"bricks\": %d,\n", runs.front().brickCount);
+    printf("  \"lights\": %d,\n", runs.front().lightCount);
+    if (replaying) {
+        printf("  \"replay\": \"%s\",\n", EscapeJson(options.replayPath).c_str());
+        if (recording.hasStateHash) {
+            printf("  \"recordedStateHash\": \"%016llx\",\n", (unsigned long long)recording.stateHash);
+        }
+    }
+    printf("  \"runs\": [\n");
+    for (size_t i = 0; i < runs.size(); i++) {
+        const HeadlessRun& run = runs[i];
+        double speedup = run.step.mean > 0.0 ? baselineStep / run.step.mean : 0.0;
+        
+        printf("    {\n");
+        printf("      \"workers\": %d,\n", run.workerCount);
+        if (run.shardCount > 1) {
+            printf("      \"shards\": {\"count\": %d, \"ghosts\": %d, \"migrations\": %d},\n",
+                run.shardCount, run.ghostCount, run.migrationCount);
+        }
+        printf("      \"framesRun\": %d,\n", run.framesRun);
+        printf("      \"stateHash\": \"%016llx\",\n", (unsigned long long)run.stateHash);
+        if (resuming) {
+            printf("      \"restoreMs\": %.3f,\n", run.restoreMs);
+        }
+        if (replaying && recording.hasStateHash) {
+            printf("      \"matchesRecording\": %s,\n", run.stateHash == recording.stateHash ? "true" : "false");
+        }
+        printf("      \"bodies\": %d,\n", run.bodyCount);
+        printf("      \"contacts\": %d,\n", run.contactCount);
+        printf("      \"debris\": {\"active\": %d, \"frozen\": %d, \"culled\": %d},\n",
+            run.activeDebris, run.frozenDebris, run.culledDebris);
+        if (run.streaming) {
+            printf("      \"stream\": {\"snapshots\": %d, \"keyframes\": %d, \"packets\": %lld, \"bytes\": %lld, "
+                   "\"bytesPerSnapshot\": %.1f, \"entries\": %lld, \"droppedPackets\": %lld, "
+                   "\"lastSequence\": %u, \"lastHash\": \"%016llx\"},\n",
+                run.streamSnapshots, run.streamKeyframes, (long long)run.streamPackets, (long long)run.streamBytes,
+                run.streamSnapshots > 0 ? (double)run.streamBytes / run.streamSnapshots : 0.0,
+                (long long)run.streamEntries, (long long)run.streamDropped,
+                run.streamSequence, (unsigned long long)run.streamHash);
+        }
+        if (run.lightmap) {
+            printf("      \"lightmap\": {\"cells\": %d, \"occluded\": %d, \"updatedCells\": %lld},\n",
+                run.lightmapCells, run.occludedCells, (long long)run.updatedCells);
+        }
+        printf("      \"stepSpeedup\": %.3f,\n", speedup);
+        printf("      \"quality\": {\"budgetMs\": %.3f", options.config.frameBudgetMs);
+        for (int level = 0; level < QualityGovernor::LEVEL_COUNT; level++) {
+            printf(", \"%s\": %d", QualityGovernor::LevelName(level), run.qualityFrames[level]);
+        }
+        printf("},\n");
+        printf("      \"memory\": {\n");
+        for (int system = 0; system < MEMORY_SYSTEM_COUNT; system++) {
+            const MemoryCounters& memory = run.memory[system];
+            printf("        \"%s\": {\"bytes\": %lld, \"peakBytes\": %lld, \"allocations\": %lld, "
+                   "\"frameAllocations\": %lld, \"steadyAllocations\": %lld},\n",
+                MemorySystemName((MemorySystem)system), (long long)memory.bytes, (long long)memory.peakBytes,
+                (long long)memory.allocations, (long long)run.frameAllocations[system],
+                (long long)run.steadyAllocations[system]);
+        }
+        printf("        \"allocatingFrames\": %d\n", run.allocatingFrames);
+        printf("      },\n");
+        printf("      \"timings\": {\n");
+        PrintSummary("step", run.step, false);
+        PrintSummary("breaks", run.breaks, false);
+        PrintSummary("update", run.update, false);
+        if (run.shardCount > 1) {
+            PrintSummary("shards", run.shards, false);
+        }
+        if (run.streaming) {
+            PrintSummary("stream", run.stream, false);
+        }
+        if (options.prepareFrames) {
+            PrintSummary("prepare", run.prepare, false);
+            PrintSummary("lighting", run.lighting, false);
+        }
+        PrintSummary("inputLatency", run.inputLatency, true);
+        printf("      },\n");
+        printf("      \"box2d\": {\n");
+        for (int zone = 0; zone < BOX2D_ZONE_COUNT; zone++) {
+            // Drop the "b2 " prefix of the zone names inside the box2d object
+            const char* name = Profiler::ZoneName((ProfileZone)((int)ProfileZone::B2Pairs + zone)) + 3;
+            PrintSummary(name, run.box2d[zone], zone + 1 == BOX2D_ZONE_COUNT);
+        }
+        printf("      }\n");
+        printf("    }%s\n", i + 1 < runs.size() ? "," : "");
+    }
+    printf("  ]\n");
+    printf("}\n");
+    
+    // A replay that diverged from the recorded session is a failure
+    if (replaying && recording.hasStateHash) {
+        for (const HeadlessRun& run : runs) {
+            if (run.stateHash != recording.stateHash) return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "game.h"
+
+// Options for running the simulation without a window
+struct HeadlessOptions {
+    int frames = 600;        // Number of frames to step
+    GameConfig config;       // Base configuration of every run, including the seed
+    
+    // Stress preset name or scene file, empty for the default arena
+    std::string scene;
+    int entityCount = 10000;  // Target body count of stress presets
+    
+    // One run per entry, each overriding the config with that many Box2D workers
+    // Speedups are reported relative to the first entry
+    std::vector<int> workerCounts = { 1 };
+    
+    // Also prepare a render frame after every update, so the culling, lighting
+    // and instance packing a windowed frame does are timed as well
+    bool prepareFrames = false;
+    
+    // Chrome trace of the first run's opening frames, skipped when empty
+    std::string tracePath;
+    int traceFrames = 300;
+    
+    // Input recording to replay instead of the options above, skipped when empty
+    // The recording's config, scene and frames replace the command line's
+    std::string replayPath;
+    
+    // Snapshot to resume instead of building a scene, skipped when empty
+    std::string snapshotPath;
+    
+    // Where the first run's final world is saved as a snapshot, skipped when empty
+    std::string saveSnapshotPath;
+};
+
+// Build the regular game world, step it for the configured number of frames
+// and print per-phase timing statistics as JSON to stdout
+// Returns the process exit code
+int RunHeadless(const HeadlessOptions& options);
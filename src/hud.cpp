@@ -1,6 +1,9 @@
 #include "hud.h"
 #include "game.h"
-#include <box2d/box2d.h>
+#include "profiler.h"
+#include "render_frame.h"
+#include "memory.h"
+#include "quality_governor.h"
 
 Hud::Hud(Game* game)
     : game(game)
@@ -9,6 +12,113 @@ Hud::Hud(Game* game)
 
 void Hud::Render() const {
     // Debug info
-    b2Counters counters = b2World_GetCounters(game->GetWorldId());
-    DrawText(TextFormat("Bodies: %d, Contacts: %d", counters.bodyCount, counters.contactCount), 10, 10, 20, WHITE);
+    // Everything comes from the drawn frame, the world may be stepping meanwhile
+    const RenderFrame& frame = game->DrawnFrame();
+    DrawText(TextFormat("Bodies: %d, Contacts: %d, Drawn: %d, Lights: %d", frame.bodyCount,
+                        frame.contactCount, frame.drawnCount, (int)frame.lights.size()),
+             10, 10, 20, WHITE);
+    
+    // Physics quality of the drawn frame's steps, lowered while frames run near their budget
+    const char* quality = QualityGovernor::LevelName(frame.qualityLevel);
+    float budgetMs = game->GetGovernor().BudgetMs();
+    const char* physics = budgetMs > 0.0f
+        ? TextFormat("Physics: %s, %d substeps (budget %.1f ms)", quality, frame.subStepCount, budgetMs)
+        : TextFormat("Physics: %s, %d substeps", quality, frame.subStepCount);
+    DrawText(physics, 10, GetScreenHeight() - 55, 20, frame.qualityLevel > 0 ? ORANGE : WHITE);
+    
+    // Input to photon, as far as the end of EndDrawing can tell
+    SampleSummary latency = game->GetProfiler().Summary(ProfileZone::Latency);
+    DrawText(TextFormat("Input latency: %.1f ms (p99 %.1f)", latency.mean, latency.p99),
+             10, GetScreenHeight() - 30, 20, WHITE);
+    
+    if (showProfiler) {
+        int y = RenderProfiler(36);
+        RenderMemory(y + 6);
+    }
+}
+
+int Hud::RenderProfiler(int y) const {
+    const Profiler& profiler = game->GetProfiler();
+    
+    const int fontSize = 10;
+    const int lineHeight = 12;
+    const int x = 10;
+    const int width = 220;
+    const int height = lineHeight * (Profiler::ZONE_COUNT + 2) + 8;
+    
+    DrawRectangle(x, y, width, height, Fade(BLACK, 0.6f));
+    
+    int lineY = y + 4;
+    DrawText(TextFormat("%d frame average", Profiler::HISTORY_FRAMES), x + 6, lineY, fontSize, LIGHTGRAY);
+    DrawText("avg ms", x + 120, lineY, fontSize, LIGHTGRAY);
+    DrawText("p99 ms", x + 170, lineY, fontSize, LIGHTGRAY);
+    lineY += lineHeight;
+    
+    // Box2D's own stages are broken out below the game's zones, in grey
+    for (int i = 0; i < Profiler::ZONE_COUNT; i++) {
+        ProfileZone zone = (ProfileZone)i;
+        SampleSummary summary = profiler.Summary(zone);
+        Color color = zone >= ProfileZone::B2Pairs ? GRAY : WHITE;
+        
+        DrawText(Profiler::ZoneName(zone), x + 6, lineY, fontSize, color);
+        DrawText(TextFormat("%6.2f", summary.mean), x + 120, lineY, fontSize, color);
+        DrawText(TextFormat("%6.2f", summary.p99), x + 170, lineY, fontSize, color);
+        lineY += lineHeight;
+    }
+    
+    const char* status = profiler.IsCapturing() ? "Capturing trace..." : "F4: capture trace";
+    DrawText(status, x + 6, lineY, fontSize, profiler.IsCapturing() ? ORANGE : LIGHTGRAY);
+    return y + height;
+}
+
+int Hud::RenderMemory(int y) const {
+    const Profiler& profiler = game->GetProfiler();
+    
+    const int fontSize = 10;
+    const int lineHeight = 12;
+    const int x = 10;
+    const int width = 220;
+    const int height = lineHeight * (MEMORY_SYSTEM_COUNT + 2) + 8;
+    
+    DrawRectangle(x, y, width, height, Fade(BLACK, 0.6f));
+    
+    int lineY = y + 4;
+    DrawText("memory", x + 6, lineY, fontSize, LIGHTGRAY);
+    DrawText("KB", x + 62, lineY, fontSize, LIGHTGRAY);
+    DrawText("peak", x + 104, lineY, fontSize, LIGHTGRAY);
+    DrawText("allocs", x + 146, lineY, fontSize, LIGHTGRAY);
+    DrawText("/frame", x + 184, lineY, fontSize, LIGHTGRAY);
+    lineY += lineHeight;
+    
+    // Any allocation in a frame is highlighted, steady frames should make none
+    int64_t totalBytes = 0;
+    int64_t totalPeak = 0;
+    int64_t totalAllocations = 0;
+    int64_t totalFrame = 0;
+    for (int i = 0; i < MEMORY_SYSTEM_COUNT; i++) {
+        MemorySystem system = (MemorySystem)i;
+        MemoryCounters counters = ReadMemory(system);
+        int64_t frameAllocations = profiler.FrameAllocations(system);
+        totalBytes += counters.bytes;
+        totalPeak += counters.peakBytes;
+        totalAllocations += counters.allocations;
+        totalFrame += frameAllocations;
+        
+        DrawText(MemorySystemName(system), x + 6, lineY, fontSize, WHITE);
+        DrawText(TextFormat("%lld", (long long)(counters.bytes / 1024)), x + 62, lineY, fontSize, WHITE);
+        DrawText(TextFormat("%lld", (long long)(counters.peakBytes / 1024)), x + 104, lineY, fontSize, WHITE);
+        DrawText(TextFormat("%lld", (long long)counters.allocations), x + 146, lineY, fontSize, WHITE);
+        DrawText(TextFormat("%lld", (long long)frameAllocations), x + 184, lineY, fontSize,
+                 frameAllocations > 0 ? ORANGE : WHITE);
+        lineY += lineHeight;
+    }
+    
+    // Peaks of different systems need not coincide, their sum is an upper bound
+    DrawText("total", x + 6, lineY, fontSize, LIGHTGRAY);
+    DrawText(TextFormat("%lld", (long long)(totalBytes / 1024)), x + 62, lineY, fontSize, LIGHTGRAY);
+    DrawText(TextFormat("%lld", (long long)(totalPeak / 1024)), x + 104, lineY, fontSize, LIGHTGRAY);
+    DrawText(TextFormat("%lld", (long long)totalAllocations), x + 146, lineY, fontSize, LIGHTGRAY);
+    DrawText(TextFormat("%lld", (long long)totalFrame), x + 184, lineY, fontSize,
+             totalFrame > 0 ? ORANGE : LIGHTGRAY);
+    return y + height;
 }
@@ -11,7 +11,16 @@ public:
     ~Hud() override = default;
 
     void Render() const override;
+    
+    // Show or hide the profiler and memory panels
+    void ToggleProfiler() { showProfiler = !showProfiler; }
+    bool IsProfilerVisible() const { return showProfiler; }
 
 private:
     Game* game;
+    bool showProfiler = false;
+    
+    // Each panel is drawn from the top y and returns the y below it
+    int RenderProfiler(int y) const;
+    int RenderMemory(int y) const;
 };
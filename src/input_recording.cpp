@@ -0,0 +1,150 @@
+#include "input_recording.h"
+#include <cstring>
+
+static const char RECORDING_MAGIC[4] = { 'R', 'C', 'I', 'N' };
+static constexpr uint32_t RECORDING_VERSION = 3;
+
+template <typename T>
+static bool WriteValue(FILE* file, const T& value) {
+    return fwrite(&value, sizeof(T), 1, file) == 1;
+}
+
+template <typename T>
+static bool ReadValue(FILE* file, T& value) {
+    return fread(&value, sizeof(T), 1, file) == 1;
+}
+
+InputRecorder::~InputRecorder() {
+    // Without a final state the file still replays, it just cannot be verified
+    if (file) fclose(file);
+}
+
+bool InputRecorder::Open(const char* path, const GameConfig& config, const std::string& scene, int entityCount) {
+    file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "recording: cannot write %s\n", path);
+        return false;
+    }
+
+    // Settings are written field by field so padding never reaches the file
+    // The worker count is informational, Box2D steps the same with any number of workers
+    // The shard count is not, contacts across shard borders are simulated differently
+    fwrite(RECORDING_MAGIC, 1, sizeof(RECORDING_MAGIC), file);
+    WriteValue(file, RECORDING_VERSION);
+    WriteValue(file, (uint32_t)config.seed);
+    WriteValue(file, config.simRate);
+    WriteValue(file, (int32_t)config.subStepCount);
+    WriteValue(file, (int32_t)config.maxCatchUpSteps);
+    WriteValue(file, config.debrisSettleTime);
+    WriteValue(file, (int32_t)config.maxActiveDebris);
+    WriteValue(file, (uint8_t)config.cullDebris);
+    WriteValue(file, (int32_t)config.workerCount);
+    WriteValue(file, (int32_t)config.shardCount);
+    WriteValue(file, (int32_t)entityCount);
+    WriteValue(file, (uint32_t)scene.size());
+    fwrite(scene.data(), 1, scene.size(), file);
+
+    // Zero frames and no hash mark a recording that was never finished
+    footerOffset = ftell(file);
+    frameCount = 0;
+    WriteValue(file, (uint32_t)0);
+    WriteValue(file, (uint8_t)0);
+    WriteValue(file, (uint64_t)0);
+
+    return ferror(file) == 0;
+}
+
+void InputRecorder::Record(const FrameInput& input) {
+    if (!file) return;
+    WriteValue(file, input.frameTime);
+    WriteValue(file, input.buttons);
+    WriteValue(file, input.quality);
+    frameCount++;
+}
+
+bool InputRecorder::Finish(uint64_t stateHash) {
+    if (!file) return false;
+
+    fseek(file, footerOffset, SEEK_SET);
+    WriteValue(file, frameCount);
+    WriteValue(file, (uint8_t)1);
+    WriteValue(file, stateHash);
+
+    bool ok = ferror(file) == 0;
+    ok = fclose(file) == 0 && ok;
+    file = nullptr;
+    return ok;
+}
+
+bool LoadInputRecording(const char* path, InputRecording& recording, std::string& error) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        error = std::string("cannot open recording ") + path;
+        return false;
+    }
+
+    recording = InputRecording();
+
+    char magic[4] = {};
+    uint32_t version = 0;
+    uint32_t seed = 0;
+    int32_t subStepCount = 0, maxCatchUpSteps = 0, maxActiveDebris = 0, workerCount = 0, shardCount = 0, entityCount = 0;
+    uint8_t cullDebris = 0;
+    uint32_t sceneLength = 0;
+
+    bool ok = fread(magic, 1, sizeof(magic), file) == sizeof(magic)
+        && memcmp(magic, RECORDING_MAGIC, sizeof(magic)) == 0
+        && ReadValue(file, version) && version == RECORDING_VERSION
+        && ReadValue(file, seed)
+        && ReadValue(file, recording.config.simRate)
+        && ReadValue(file, subStepCount)
+        && ReadValue(file, maxCatchUpSteps)
+        && ReadValue(file, recording.config.debrisSettleTime)
+        && ReadValue(file, maxActiveDebris)
+        && ReadValue(file, cullDebris)
+        && ReadValue(file, workerCount)
+        && ReadValue(file, shardCount)
+        && ReadValue(file, entityCount)
+        && ReadValue(file, sceneLength)
+        && sceneLength < 4096;
+
+    if (ok) {
+        recording.scene.resize(sceneLength);
+        ok = fread(recording.scene.data(), 1, sceneLength, file) == sceneLength;
+    }
+
+    uint32_t frameCount = 0;
+    uint8_t finished = 0;
+    ok = ok && ReadValue(file, frameCount) && ReadValue(file, finished) && ReadValue(file, recording.stateHash);
+
+    if (!ok) {
+        fclose(file);
+        error = std::string("not a valid input recording: ") + path;
+        return false;
+    }
+
+    recording.config.seed = seed;
+    recording.config.subStepCount = subStepCount;
+    recording.config.maxCatchUpSteps = maxCatchUpSteps;
+    recording.config.maxActiveDebris = maxActiveDebris;
+    recording.config.cullDebris = cullDebris != 0;
+    recording.config.workerCount = workerCount;
+    recording.config.shardCount = shardCount;
+    recording.entityCount = entityCount;
+    recording.hasStateHash = finished != 0;
+
+    // An unfinished recording has no frame count, so read frames until the file ends
+    FrameInput input;
+    recording.frames.reserve(frameCount);
+    while (ReadValue(file, input.frameTime) && ReadValue(file, input.buttons) && ReadValue(file, input.quality)) {
+        recording.frames.push_back(input);
+        if (finished && recording.frames.size() == frameCount) break;
+    }
+    fclose(file);
+
+    if (finished && recording.frames.size() != frameCount) {
+        error = std::string("input recording is truncated: ") + path;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "game.h"
+
+// Buttons held during a frame, one bit each
+enum InputButton : uint8_t {
+    INPUT_LEFT = 1 << 0,
+    INPUT_RIGHT = 1 << 1,
+    INPUT_UP = 1 << 2,
+    INPUT_DOWN = 1 << 3,
+    INPUT_EXIT = 1 << 4,
+};
+
+// Everything that drove one frame of the simulation
+struct FrameInput {
+    float frameTime = 0.0f;  // Seconds passed to Game::Update
+    uint8_t buttons = 0;     // InputButton bits
+    uint8_t quality = 0;     // Physics quality level the frame ran at, see QualityGovernor
+};
+
+// A recorded session: what is needed to rebuild the world plus the input of every frame
+struct InputRecording {
+    GameConfig config;        // Includes the seed of the game's random stream
+    std::string scene;        // Preset name or scene file, empty for the default arena
+    int entityCount = 0;      // Size of a preset scene
+    std::vector<FrameInput> frames;
+    bool hasStateHash = false;  // False when the session ended without closing the file
+    uint64_t stateHash = 0;     // Game::StateHash after the last frame
+};
+
+// Streams frames to a file as they happen so a crashed session still keeps
+// everything up to the last flush
+// Layout (native byte order): header, 6 bytes per frame, then the frame count
+// and final state hash patched into the header by Finish
+class InputRecorder {
+public:
+    InputRecorder() = default;
+    ~InputRecorder();
+
+    InputRecorder(const InputRecorder&) = delete;
+    InputRecorder& operator=(const InputRecorder&) = delete;
+
+    // Start a recording, config, scene and entityCount are written to the header
+    bool Open(const char* path, const GameConfig& config, const std::string& scene, int entityCount);
+    bool IsOpen() const { return file != nullptr; }
+
+    void Record(const FrameInput& input);
+
+    // Write the frame count and final state hash, then close the file
+    bool Finish(uint64_t stateHash);
+
+private:
+    FILE* file = nullptr;
+    long footerOffset = 0;  // Where the frame count and hash go
+    uint32_t frameCount = 0;
+};
+
+// Read a recording written by InputRecorder
+// Returns false and describes the problem in error if the file is invalid
+bool LoadInputRecording(const char* path, InputRecording& recording, std::string& error);
@@ -0,0 +1,236 @@
+#include "light_field.h"
+#include "FakeLight.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RAYCODE_HAS_SSE2 1
+#endif
+
+float LightField::Reach(Vector3 attenuation) {
+    float c = attenuation.x - 1.0f / CUTOFF;
+    float l = attenuation.y;
+    float q = attenuation.z;
+    
+    if (c >= 0.0f) return 0.0f;  // Dimmer than the cutoff everywhere
+    if (q > 0.0f) return (-l + sqrtf(l * l - 4.0f * q * c)) / (2.0f * q);
+    if (l > 0.0f) return -c / l;
+    return -1.0f;
+}
+
+void LightField::Build(const std::vector<FakeLight>& lights, float worldWidth, float worldHeight) {
+    lightCount = (int)lights.size();
+    directionalCount = 0;
+    directionalX = 0.0f;
+    directionalY = 0.0f;
+    
+    // Cap the tile count so huge worlds do not cost huge tile tables
+    tileSize = std::max(TILE_SIZE, std::max(worldWidth, worldHeight) / MAX_TILES_PER_SIDE);
+    columns = std::max((int)ceilf(worldWidth / tileSize), 1);
+    rows = std::max((int)ceilf(worldHeight / tileSize), 1);
+    int tileCount = columns * rows;
+    
+    // First pass: the tile range of every point light and how many lights each tile gets
+    cursor.assign(tileCount, 0);
+    lightTiles.clear();
+    for (const FakeLight& light : lights) {
+        if (light.GetType() == LightType::Directional) {
+            directionalCount++;
+            directionalX += light.GetDirection().x;
+            directionalY += light.GetDirection().y;
+            continue;
+        }
+        
+        Vector2 position = light.GetPosition();
+        float radius = Reach(light.GetAttenuation());
+        int minX = 0, minY = 0, maxX = columns - 1, maxY = rows - 1;
+        if (radius == 0.0f) {
+            maxX = maxY = -1;  // An empty range, the light reaches no tile
+        } else if (radius > 0.0f) {
+            minX = std::max((int)floorf((position.x - radius) / tileSize), 0);
+            minY = std::max((int)floorf((position.y - radius) / tileSize), 0);
+            maxX = std::min((int)floorf((position.x + radius) / tileSize), columns - 1);
+            maxY = std::min((int)floorf((position.y + radius) / tileSize), rows - 1);
+        }
+        
+        lightTiles.insert(lightTiles.end(), { minX, minY, maxX, maxY });
+        for (int y = minY; y <= maxY; y++) {
+            for (int x = minX; x <= maxX; x++) {
+                cursor[y * columns + x]++;
+            }
+        }
+    }
+    
+    tileStart.assign(tileCount + 1, 0);
+    for (int t = 0; t < tileCount; t++) {
+        tileStart[t + 1] = tileStart[t] + cursor[t];
+        cursor[t] = tileStart[t];
+    }
+    
+    int entryCount = tileStart[tileCount];
+    lightX.resize(entryCount);
+    lightY.resize(entryCount);
+    constant.resize(entryCount);
+    linear.resize(entryCount);
+    quadratic.resize(entryCount);
+    
+    // Second pass: copy each point light into every tile it reaches
+    size_t range = 0;
+    for (const FakeLight& light : lights) {
+        if (light.GetType() == LightType::Directional) continue;
+        
+        const int* tiles = &lightTiles[range];
+        range += 4;
+        Vector2 position = light.GetPosition();
+        Vector3 attenuation = light.GetAttenuation();
+        
+        for (int y = tiles[1]; y <= tiles[3]; y++) {
+            for (int x = tiles[0]; x <= tiles[2]; x++) {
+                int entry = cursor[y * columns + x]++;
+                lightX[entry] = position.x;
+                lightY[entry] = position.y;
+                constant[entry] = attenuation.x;
+                linear[entry] = attenuation.y;
+                quadratic[entry] = attenuation.z;
+            }
+        }
+    }
+}
+
+int LightField::TileOf(float x, float y) const {
+    // Points off the world use the nearest edge tile
+    int column = std::clamp((int)(x / tileSize), 0, columns - 1);
+    int row = std::clamp((int)(y / tileSize), 0, rows - 1);
+    return row * columns + column;
+}
+
+void LightField::Evaluate(const float* xs, const float* ys, int count,
+                          float* intensity, float* directionX, float* directionY) {
+    if (count <= 0) return;
+    
+    // Sort the points by tile (a counting sort), so every tile's points sit
+    // next to each other in the packed arrays and share one light list
+    int tileCount = columns * rows;
+    cursor.assign(tileCount + 1, 0);
+    pointTiles.resize(count);
+    for (int i = 0; i < count; i++) {
+        pointTiles[i] = TileOf(xs[i], ys[i]);
+        cursor[pointTiles[i] + 1]++;
+    }
+    for (int t = 0; t < tileCount; t++) {
+        cursor[t + 1] += cursor[t];
+    }
+    
+    order.resize(count);
+    sortedX.resize(count);
+    sortedY.resize(count);
+    for (int i = 0; i < count; i++) {
+        int slot = cursor[pointTiles[i]]++;
+        order[slot] = i;
+        sortedX[slot] = xs[i];
+        sortedY[slot] = ys[i];
+    }
+    
+    sumIntensity.assign(count, 0.0f);
+    sumX.assign(count, 0.0f);
+    sumY.assign(count, 0.0f);
+    
+    // After the sort each cursor holds the end of its tile's points
+    int first = 0;
+    for (int t = 0; t < tileCount; t++) {
+        int last = cursor[t];
+        if (last > first && tileStart[t + 1] > tileStart[t]) ShadeTile(t, first, last);
+        first = last;
+    }
+    
+    // Add the directional lights, clamp and turn the sums into unit directions
+    for (int slot = 0; slot < count; slot++) {
+        float total = sumIntensity[slot] + (float)directionalCount;
+        float x = sumX[slot] + directionalX;
+        float y = sumY[slot] + directionalY;
+        
+        float length = sqrtf(x * x + y * y);
+        int i = order[slot];
+        intensity[i] = std::min(total, 1.0f);
+        if (length > 0.001f) {
+            directionX[i] = x / length;
+            directionY[i] = y / length;
+        } else {
+            directionX[i] = 0.0f;  // Default to up, as FakeLight does
+            directionY[i] = -1.0f;
+        }
+    }
+}
+
+void LightField::ShadeTile(int tile, int first, int last) {
+    int lightBegin = tileStart[tile];
+    int lightEnd = tileStart[tile + 1];
+    int i = first;
+    
+#ifdef RAYCODE_HAS_SSE2
+    // Four points against one light per iteration, same maths as the scalar loop below
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 epsilon = _mm_set1_ps(0.001f);
+    const __m128 cutoff = _mm_set1_ps(CUTOFF);
+    
+    for (; i + 4 <= last; i += 4) {
+        __m128 px = _mm_loadu_ps(&sortedX[i]);
+        __m128 py = _mm_loadu_ps(&sortedY[i]);
+        __m128 totalIntensity = zero;
+        __m128 totalX = zero;
+        __m128 totalY = zero;
+        
+        for (int j = lightBegin; j < lightEnd; j++) {
+            __m128 dx = _mm_sub_ps(_mm_set1_ps(lightX[j]), px);
+            __m128 dy = _mm_sub_ps(_mm_set1_ps(lightY[j]), py);
+            __m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+            __m128 d = _mm_sqrt_ps(d2);
+            
+            __m128 denominator = _mm_add_ps(_mm_set1_ps(constant[j]),
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(linear[j]), d), _mm_mul_ps(_mm_set1_ps(quadratic[j]), d2)));
+            __m128 attenuation = _mm_min_ps(_mm_div_ps(one, denominator), one);
+            attenuation = _mm_and_ps(_mm_cmpge_ps(attenuation, cutoff), attenuation);
+            
+            // Points on top of the light get no direction from it
+            __m128 inverse = _mm_and_ps(_mm_cmpgt_ps(d, epsilon), _mm_div_ps(one, d));
+            __m128 weight = _mm_mul_ps(attenuation, inverse);
+            
+            totalIntensity = _mm_add_ps(totalIntensity, attenuation);
+            totalX = _mm_add_ps(totalX, _mm_mul_ps(dx, weight));
+            totalY = _mm_add_ps(totalY, _mm_mul_ps(dy, weight));
+        }
+        
+        _mm_storeu_ps(&sumIntensity[i], totalIntensity);
+        _mm_storeu_ps(&sumX[i], totalX);
+        _mm_storeu_ps(&sumY[i], totalY);
+    }
+#endif
+    
+    for (; i < last; i++) {
+        float totalIntensity = 0.0f;
+        float totalX = 0.0f;
+        float totalY = 0.0f;
+        
+        for (int j = lightBegin; j < lightEnd; j++) {
+            float dx = lightX[j] - sortedX[i];
+            float dy = lightY[j] - sortedY[i];
+            float d2 = dx * dx + dy * dy;
+            float d = sqrtf(d2);
+            
+            float attenuation = 1.0f / (constant[j] + linear[j] * d + quadratic[j] * d2);
+            attenuation = std::min(attenuation, 1.0f);
+            if (attenuation < CUTOFF) attenuation = 0.0f;
+            float weight = d > 0.001f ? attenuation / d : 0.0f;
+            
+            totalIntensity += attenuation;
+            totalX += dx * weight;
+            totalY += dy * weight;
+        }
+        
+        sumIntensity[i] = totalIntensity;
+        sumX[i] = totalX;
+        sumY[i] = totalY;
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <raylib.h>
+#include <vector>
+#include "memory.h"
+
+class FakeLight;
+
+// Lighting of many balls by many lights, evaluated on the CPU in one pass
+// Point lights are binned into square tiles out to the distance where they
+// fade below CUTOFF, so each ball only visits the lights of its own tile.
+// Contributions below CUTOFF are dropped everywhere, so the binning never
+// changes the result.
+// Balls are sorted by tile into packed position arrays and shaded four at a
+// time with SSE2, with a scalar path for the remainder and other targets
+class LightField {
+public:
+    // Bin the lights over a world of the given size (pixels)
+    void Build(const std::vector<FakeLight>& lights, float worldWidth, float worldHeight);
+    
+    // Combined light at count points given as packed x and y arrays (pixels)
+    // Writes the intensity (0 to 1) and the unit direction towards the light,
+    // the sum of every light weighted by its intensity
+    void Evaluate(const float* xs, const float* ys, int count,
+                  float* intensity, float* directionX, float* directionY);
+    
+    bool HasLights() const { return lightCount > 0; }
+    int LightCount() const { return lightCount; }
+    
+    // Light entries over all tiles, a point light is counted once per tile it reaches
+    int TileEntryCount() const { return (int)lightX.size(); }
+    
+    // Distance at which a point light with the given attenuation fades to
+    // CUTOFF, 0 if it is dimmer everywhere, negative if it never fades that far
+    static float Reach(Vector3 attenuation);
+
+    static constexpr float TILE_SIZE = 256.0f;   // Pixels
+    static constexpr int MAX_TILES_PER_SIDE = 256;  // Larger worlds get larger tiles
+    static constexpr float CUTOFF = 0.02f;       // Intensity below which a light is ignored
+
+private:
+    int lightCount = 0;
+    int columns = 1;
+    int rows = 1;
+    float tileSize = TILE_SIZE;
+    
+    // Point lights of tile t are entries tileStart[t] to tileStart[t + 1],
+    // stored as parallel arrays so a light's terms load without gathering
+    TrackedVector<int, MemorySystem::Render> tileStart;
+    TrackedVector<float, MemorySystem::Render> lightX;
+    TrackedVector<float, MemorySystem::Render> lightY;
+    TrackedVector<float, MemorySystem::Render> constant;
+    TrackedVector<float, MemorySystem::Render> linear;
+    TrackedVector<float, MemorySystem::Render> quadratic;
+    
+    // Directional lights reach everything at full intensity, so only their sum matters
+    int directionalCount = 0;
+    float directionalX = 0.0f;
+    float directionalY = 0.0f;
+    
+    // Scratch space of Build and Evaluate, kept to avoid per-frame allocations
+    TrackedVector<int, MemorySystem::Render> cursor;
+    TrackedVector<int, MemorySystem::Render> lightTiles;   // Tile range of each point light
+    TrackedVector<int, MemorySystem::Render> pointTiles;   // Tile of each evaluated point
+    TrackedVector<int, MemorySystem::Render> order;        // Evaluated points sorted by tile
+    TrackedVector<float, MemorySystem::Render> sortedX;
+    TrackedVector<float, MemorySystem::Render> sortedY;
+    TrackedVector<float, MemorySystem::Render> sumIntensity;
+    TrackedVector<float, MemorySystem::Render> sumX;
+    TrackedVector<float, MemorySystem::Render> sumY;
+
+    int TileOf(float x, float y) const;
+    void ShadeTile(int tile, int first, int last);
+};
@@ -0,0 +1,332 @@
+#include "lightmap.h"
+#include "light_field.h"
+#include "FakeLight.h"
+#include "brick.h"
+#include "game.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+void Lightmap::Reset(float worldWidth, float worldHeight, const BrickStore& bricks) {
+    // Cap the cell count so huge worlds do not cost huge grids
+    cellSize = std::max(CELL_SIZE, std::max(worldWidth, worldHeight) / MAX_CELLS_PER_SIDE);
+    columns = std::max((int)ceilf(worldWidth / cellSize), 1);
+    rows = std::max((int)ceilf(worldHeight / cellSize), 1);
+    int cellCount = columns * rows;
+
+    occluders.assign(cellCount, 0);
+    sumIntensity.assign(cellCount, 0.0f);
+    sumX.assign(cellCount, 0.0f);
+    sumY.assign(cellCount, 0.0f);
+    dirty.assign(cellCount, 0);
+    dirtyCells.clear();
+    clearedCells.clear();
+    sources.clear();
+    allDirty = true;
+    occludedCount = 0;
+    lastUpdated = 0;
+    totalUpdated = 0;
+
+    for (int i = 0; i < bricks.Count(); i++) {
+        if (!bricks.IsAttached(i)) continue;
+
+        int minX, minY, maxX, maxY;
+        if (!BrickCells(bricks.GetTransform(i), minX, minY, maxX, maxY)) continue;
+        for (int y = minY; y <= maxY; y++) {
+            for (int x = minX; x <= maxX; x++) {
+                if (occluders[y * columns + x]++ == 0) occludedCount++;
+            }
+        }
+    }
+}
+
+void Lightmap::RemoveOccluder(const b2Transform& transform) {
+    int minX, minY, maxX, maxY;
+    if (!BrickCells(transform, minX, minY, maxX, maxY)) return;
+
+    // A cell stays dark while another brick still overlaps it
+    for (int y = minY; y <= maxY; y++) {
+        for (int x = minX; x <= maxX; x++) {
+            int cell = y * columns + x;
+            if (occluders[cell] == 0 || --occluders[cell] > 0) continue;
+            occludedCount--;
+            clearedCells.push_back(cell);
+        }
+    }
+}
+
+void Lightmap::Update(const std::vector<FakeLight>& lights) {
+    lightCount = (int)lights.size();
+    directionalCount = 0;
+    directionalX = 0.0f;
+    directionalY = 0.0f;
+
+    // A point light that changed dirties where it reached and where it reaches now
+    size_t pointCount = 0;
+    for (const FakeLight& light : lights) {
+        if (light.GetType() == LightType::Directional) {
+            directionalCount++;
+            directionalX += light.GetDirection().x;
+            directionalY += light.GetDirection().y;
+            continue;
+        }
+
+        Vector2 position = light.GetPosition();
+        Vector3 attenuation = light.GetAttenuation();
+        Source source = { position.x, position.y, attenuation.x, attenuation.y, attenuation.z,
+                          LightField::Reach(attenuation) };
+        if (pointCount == sources.size()) {
+            MarkReach(source);
+            sources.push_back(source);
+        } else if (!(sources[pointCount] == source)) {
+            MarkReach(sources[pointCount]);
+            MarkReach(source);
+            sources[pointCount] = source;
+        }
+        pointCount++;
+    }
+    while (sources.size() > pointCount) {
+        MarkReach(sources.back());
+        sources.pop_back();
+    }
+
+    // A cell that stopped occluding lets every light through into its shadow
+    for (int cell : clearedCells) {
+        for (const Source& source : sources) {
+            MarkShadow(source, cell);
+        }
+    }
+    clearedCells.clear();
+
+    if (allDirty) {
+        lastUpdated = columns * rows;
+        for (int cell = 0; cell < lastUpdated; cell++) {
+            ShadeCell(cell);
+        }
+        allDirty = false;
+
+        // Cells marked before the whole grid was dirtied are shaded too
+        for (int cell : dirtyCells) {
+            dirty[cell] = 0;
+        }
+    } else {
+        lastUpdated = (int)dirtyCells.size();
+        for (int cell : dirtyCells) {
+            ShadeCell(cell);
+            dirty[cell] = 0;
+        }
+    }
+    dirtyCells.clear();
+    totalUpdated += lastUpdated;
+}
+
+void Lightmap::Evaluate(const float* xs, const float* ys, int count,
+                        float* intensity, float* directionX, float* directionY) const {
+    for (int i = 0; i < count; i++) {
+        // Blend the four cell centres around the point, clamped at the edges,
+        // which also softens shadow borders over a cell
+        float gridX = std::clamp(xs[i] / cellSize - 0.5f, 0.0f, (float)(columns - 1));
+        float gridY = std::clamp(ys[i] / cellSize - 0.5f, 0.0f, (float)(rows - 1));
+        int x0 = (int)gridX;
+        int y0 = (int)gridY;
+        int x1 = std::min(x0 + 1, columns - 1);
+        int y1 = std::min(y0 + 1, rows - 1);
+        float fx = gridX - (float)x0;
+        float fy = gridY - (float)y0;
+
+        int c00 = y0 * columns + x0;
+        int c10 = y0 * columns + x1;
+        int c01 = y1 * columns + x0;
+        int c11 = y1 * columns + x1;
+        auto blend = [&](const TrackedVector<float, MemorySystem::Render>& values) {
+            float top = values[c00] + (values[c10] - values[c00]) * fx;
+            float bottom = values[c01] + (values[c11] - values[c01]) * fx;
+            return top + (bottom - top) * fy;
+        };
+
+        // Add the directional lights, clamp and turn the sums into unit
+        // directions, as LightField does
+        float total = blend(sumIntensity) + (float)directionalCount;
+        float x = blend(sumX) + directionalX;
+        float y = blend(sumY) + directionalY;
+
+        float length = sqrtf(x * x + y * y);
+        intensity[i] = std::min(total, 1.0f);
+        if (length > 0.001f) {
+            directionX[i] = x / length;
+            directionY[i] = y / length;
+        } else {
+            directionX[i] = 0.0f;  // Default to up, as FakeLight does
+            directionY[i] = -1.0f;
+        }
+    }
+}
+
+bool Lightmap::BrickCells(const b2Transform& transform, int& minX, int& minY, int& maxX, int& maxY) const {
+    // Attached bricks line up with their wall, so their box is axis aligned
+    // Shrunk slightly so a brick flush with a cell border stays out of the next cell
+    float extentX = BrickStore::BRICK_WIDTH - 0.5f;
+    float extentY = BrickStore::BRICK_HEIGHT - 0.5f;
+    float x = transform.p.x * Game::PIXELS_PER_METER;
+    float y = transform.p.y * Game::PIXELS_PER_METER;
+
+    minX = std::max((int)floorf((x - extentX) / cellSize), 0);
+    minY = std::max((int)floorf((y - extentY) / cellSize), 0);
+    maxX = std::min((int)floorf((x + extentX) / cellSize), columns - 1);
+    maxY = std::min((int)floorf((y + extentY) / cellSize), rows - 1);
+    return minX <= maxX && minY <= maxY;
+}
+
+void Lightmap::MarkRect(float minX, float minY, float maxX, float maxY) {
+    if (allDirty) return;
+
+    int left = std::max((int)floorf(minX / cellSize), 0);
+    int top = std::max((int)floorf(minY / cellSize), 0);
+    int right = std::min((int)floorf(maxX / cellSize), columns - 1);
+    int bottom = std::min((int)floorf(maxY / cellSize), rows - 1);
+    for (int y = top; y <= bottom; y++) {
+        for (int x = left; x <= right; x++) {
+            int cell = y * columns + x;
+            if (dirty[cell]) continue;
+            dirty[cell] = 1;
+            dirtyCells.push_back(cell);
+        }
+    }
+}
+
+void Lightmap::MarkReach(const Source& source) {
+    if (source.radius == 0.0f) return;
+    if (source.radius < 0.0f) {
+        allDirty = true;
+        return;
+    }
+    MarkRect(source.x - source.radius, source.y - source.radius,
+             source.x + source.radius, source.y + source.radius);
+}
+
+void Lightmap::MarkShadow(const Source& source, int cell) {
+    if (source.radius == 0.0f || allDirty) return;
+
+    // A light that never fades shadows all the way across the grid
+    float radius = source.radius > 0.0f ? source.radius : (float)(columns + rows) * cellSize;
+    float x0 = (float)(cell % columns) * cellSize;
+    float y0 = (float)(cell / columns) * cellSize;
+    float x1 = x0 + cellSize;
+    float y1 = y0 + cellSize;
+
+    // Cells out of the light's reach were dark on both sides of the change
+    float nearX = std::clamp(source.x, x0, x1) - source.x;
+    float nearY = std::clamp(source.y, y0, y1) - source.y;
+    if (nearX * nearX + nearY * nearY > radius * radius) return;
+
+    // A light inside the cell shadowed every direction
+    if (nearX == 0.0f && nearY == 0.0f) {
+        MarkRect(source.x - radius, source.y - radius, source.x + radius, source.y + radius);
+        return;
+    }
+
+    // The shadow is the wedge behind the cell, out to the light's reach: it
+    // lies within the box of the cell, the cell's corners pushed out to the
+    // reach and the points of the reach circle along the axes inside the wedge
+    float centreX = (x0 + x1) * 0.5f - source.x;
+    float centreY = (y0 + y1) * 0.5f - source.y;
+    float centreLength = sqrtf(centreX * centreX + centreY * centreY);
+    centreX /= centreLength;
+    centreY /= centreLength;
+
+    float minX = x0, minY = y0, maxX = x1, maxY = y1;
+    float minCos = 1.0f;
+    const float corners[4][2] = { { x0, y0 }, { x1, y0 }, { x0, y1 }, { x1, y1 } };
+    for (const float* corner : corners) {
+        float dx = corner[0] - source.x;
+        float dy = corner[1] - source.y;
+        float length = sqrtf(dx * dx + dy * dy);
+        dx /= length;
+        dy /= length;
+        minCos = std::min(minCos, dx * centreX + dy * centreY);
+
+        float x = source.x + dx * radius;
+        float y = source.y + dy * radius;
+        minX = std::min(minX, x);
+        minY = std::min(minY, y);
+        maxX = std::max(maxX, x);
+        maxY = std::max(maxY, y);
+    }
+
+    const float axes[4][2] = { { 1.0f, 0.0f }, { -1.0f, 0.0f }, { 0.0f, 1.0f }, { 0.0f, -1.0f } };
+    for (const float* axis : axes) {
+        if (axis[0] * centreX + axis[1] * centreY < minCos) continue;
+        float x = source.x + axis[0] * radius;
+        float y = source.y + axis[1] * radius;
+        minX = std::min(minX, x);
+        minY = std::min(minY, y);
+        maxX = std::max(maxX, x);
+        maxY = std::max(maxY, y);
+    }
+
+    MarkRect(minX, minY, maxX, maxY);
+}
+
+bool Lightmap::IsVisible(float x, float y, float lightX, float lightY) const {
+    // Walk the cells on the line to the light (Amanatides and Woo), in cell units
+    float fromX = x / cellSize;
+    float fromY = y / cellSize;
+    float dx = lightX / cellSize - fromX;
+    float dy = lightY / cellSize - fromY;
+    int cellX = (int)floorf(fromX);
+    int cellY = (int)floorf(fromY);
+    int steps = abs((int)floorf(lightX / cellSize) - cellX) + abs((int)floorf(lightY / cellSize) - cellY);
+
+    int stepX = dx > 0.0f ? 1 : -1;
+    int stepY = dy > 0.0f ? 1 : -1;
+    float deltaX = dx != 0.0f ? fabsf(1.0f / dx) : INFINITY;
+    float deltaY = dy != 0.0f ? fabsf(1.0f / dy) : INFINITY;
+    float nextX = dx != 0.0f ? (dx > 0.0f ? (float)(cellX + 1) - fromX : fromX - (float)cellX) * deltaX : INFINITY;
+    float nextY = dy != 0.0f ? (dy > 0.0f ? (float)(cellY + 1) - fromY : fromY - (float)cellY) * deltaY : INFINITY;
+
+    // Neither end shadows itself, so only the cells strictly between them count
+    for (int i = 1; i < steps; i++) {
+        if (nextX < nextY) {
+            cellX += stepX;
+            nextX += deltaX;
+        } else {
+            cellY += stepY;
+            nextY += deltaY;
+        }
+
+        // The rest of the way to a light off the grid is open
+        if (cellX < 0 || cellY < 0 || cellX >= columns || cellY >= rows) return true;
+        if (occluders[cellY * columns + cellX] > 0) return false;
+    }
+    return true;
+}
+
+void Lightmap::ShadeCell(int cell) {
+    float x = ((float)(cell % columns) + 0.5f) * cellSize;
+    float y = ((float)(cell / columns) + 0.5f) * cellSize;
+    float totalIntensity = 0.0f;
+    float totalX = 0.0f;
+    float totalY = 0.0f;
+
+    // Same falloff and cutoff as LightField, once the light is known to reach
+    for (const Source& source : sources) {
+        float dx = source.x - x;
+        float dy = source.y - y;
+        float d2 = dx * dx + dy * dy;
+        if (source.radius >= 0.0f && d2 > source.radius * source.radius) continue;
+
+        float d = sqrtf(d2);
+        float attenuation = 1.0f / (source.constant + source.linear * d + source.quadratic * d2);
+        attenuation = std::min(attenuation, 1.0f);
+        if (attenuation < LightField::CUTOFF || !IsVisible(x, y, source.x, source.y)) continue;
+
+        float weight = d > 0.001f ? attenuation / d : 0.0f;
+        totalIntensity += attenuation;
+        totalX += dx * weight;
+        totalY += dy * weight;
+    }
+
+    sumIntensity[cell] = totalIntensity;
+    sumX[cell] = totalX;
+    sumY[cell] = totalY;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <box2d/box2d.h>
+#include <cstdint>
+#include <vector>
+#include "memory.h"
+
+class FakeLight;
+class BrickStore;
+
+// Shadowed lighting of the play area, kept in a low resolution grid
+// Attached bricks are rasterised into an occluder grid of the same cells,
+// and every cell sums the point lights that reach its centre through a
+// clear line of cells, so walls cast hard shadows that soften over a cell
+// when sampled. The grid is only recomputed where something changed: the
+// shadows behind a brick that broke off its wall and the reach of a light
+// that moved, so a steady scene costs nothing per frame.
+// Directional lights have no position to cast from and light everything.
+// Sampling a point is a bilinear lookup, whatever the number of lights.
+class Lightmap {
+public:
+    // Size the grid to a world (pixels) and rasterise its attached bricks
+    // Every cell is recomputed by the next Update
+    void Reset(float worldWidth, float worldHeight, const BrickStore& bricks);
+
+    // A brick left its wall, so it no longer casts a shadow
+    // The cells in its shadow are recomputed by the next Update
+    void RemoveOccluder(const b2Transform& transform);
+
+    // Recompute the cells dirtied by removed occluders and by lights that
+    // moved or changed since the last Update
+    void Update(const std::vector<FakeLight>& lights);
+
+    // Combined light at count points given as packed x and y arrays (pixels),
+    // with the same results as LightField::Evaluate on an unshadowed world
+    void Evaluate(const float* xs, const float* ys, int count,
+                  float* intensity, float* directionX, float* directionY) const;
+
+    bool HasLights() const { return lightCount > 0; }
+    int CellCount() const { return columns * rows; }
+    int OccludedCellCount() const { return occludedCount; }
+
+    // Cells recomputed by the last Update and since the last Reset
+    int LastUpdatedCells() const { return lastUpdated; }
+    int64_t UpdatedCells() const { return totalUpdated; }
+
+    static constexpr float CELL_SIZE = 16.0f;       // Pixels, about a brick
+    static constexpr int MAX_CELLS_PER_SIDE = 512;  // Larger worlds get larger cells
+
+private:
+    // A point light as last seen by Update, to notice when it changes
+    struct Source {
+        float x, y;
+        float constant, linear, quadratic;
+        float radius;  // Where it fades below LightField::CUTOFF, negative if never
+        
+        bool operator==(const Source&) const = default;
+    };
+
+    int columns = 1;
+    int rows = 1;
+    float cellSize = CELL_SIZE;
+    int lightCount = 0;
+    int occludedCount = 0;
+    int lastUpdated = 0;
+    int64_t totalUpdated = 0;
+
+    // Per cell: attached bricks overlapping it, and the sums of the point
+    // lights reaching its centre, directions weighted by intensity
+    TrackedVector<uint16_t, MemorySystem::Render> occluders;
+    TrackedVector<float, MemorySystem::Render> sumIntensity;
+    TrackedVector<float, MemorySystem::Render> sumX;
+    TrackedVector<float, MemorySystem::Render> sumY;
+
+    TrackedVector<Source, MemorySystem::Render> sources;
+    int directionalCount = 0;
+    float directionalX = 0.0f;
+    float directionalY = 0.0f;
+
+    // Cells to recompute, each listed once and flagged in dirty
+    TrackedVector<uint8_t, MemorySystem::Render> dirty;
+    TrackedVector<int, MemorySystem::Render> dirtyCells;
+    bool allDirty = false;
+
+    // Cells that lost their last occluder since the last Update
+    TrackedVector<int, MemorySystem::Render> clearedCells;
+
+    // Range of cells overlapped by a brick, returned as false when it is off the grid
+    bool BrickCells(const b2Transform& transform, int& minX, int& minY, int& maxX, int& maxY) const;
+    void MarkRect(float minX, float minY, float maxX, float maxY);
+    void MarkReach(const Source& source);
+    void MarkShadow(const Source& source, int cell);
+    bool IsVisible(float x, float y, float lightX, float lightY) const;
+    void ShadeCell(int cell);
+};
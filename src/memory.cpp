@@ -0,0 +1,95 @@
+#include "memory.h"
+#include <box2d/box2d.h>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+
+struct SystemCounters {
+    std::atomic<int64_t> bytes{0};
+    std::atomic<int64_t> peakBytes{0};
+    std::atomic<int64_t> allocations{0};
+    std::atomic<int64_t> frees{0};
+};
+
+static SystemCounters counters[MEMORY_SYSTEM_COUNT];
+
+// Box2D's free function gets no size, so every block starts with a header
+// holding the size and the pointer malloc returned, just below the aligned
+// address handed to Box2D
+struct BlockHeader {
+    void* raw;
+    size_t size;
+};
+
+static void* Box2DAlloc(unsigned int size, int alignment) {
+    size_t align = alignment > (int)alignof(BlockHeader) ? (size_t)alignment : alignof(BlockHeader);
+    void* raw = malloc(size + sizeof(BlockHeader) + align);
+    if (!raw) return nullptr;
+
+    uintptr_t start = (uintptr_t)raw + sizeof(BlockHeader);
+    uintptr_t aligned = (start + align - 1) & ~(uintptr_t)(align - 1);
+
+    BlockHeader* header = (BlockHeader*)aligned - 1;
+    header->raw = raw;
+    header->size = size;
+    TrackAllocation(MemorySystem::Box2D, size);
+    return (void*)aligned;
+}
+
+static void Box2DFree(void* memory) {
+    if (!memory) return;
+    BlockHeader* header = (BlockHeader*)memory - 1;
+    TrackFree(MemorySystem::Box2D, header->size);
+    free(header->raw);
+}
+
+void TrackAllocation(MemorySystem system, size_t size) {
+    SystemCounters& tracked = counters[(int)system];
+    int64_t bytes = tracked.bytes.fetch_add((int64_t)size, std::memory_order_relaxed) + (int64_t)size;
+    tracked.allocations.fetch_add(1, std::memory_order_relaxed);
+
+    int64_t peak = tracked.peakBytes.load(std::memory_order_relaxed);
+    while (bytes > peak && !tracked.peakBytes.compare_exchange_weak(peak, bytes, std::memory_order_relaxed)) {
+    }
+}
+
+void TrackFree(MemorySystem system, size_t size) {
+    SystemCounters& tracked = counters[(int)system];
+    tracked.bytes.fetch_sub((int64_t)size, std::memory_order_relaxed);
+    tracked.frees.fetch_add(1, std::memory_order_relaxed);
+}
+
+MemoryCounters ReadMemory(MemorySystem system) {
+    const SystemCounters& tracked = counters[(int)system];
+    MemoryCounters result;
+    result.bytes = tracked.bytes.load(std::memory_order_relaxed);
+    result.peakBytes = tracked.peakBytes.load(std::memory_order_relaxed);
+    result.allocations = tracked.allocations.load(std::memory_order_relaxed);
+    result.frees = tracked.frees.load(std::memory_order_relaxed);
+    return result;
+}
+
+void ResetMemoryPeaks() {
+    for (SystemCounters& system : counters) {
+        system.peakBytes.store(system.bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+}
+
+const char* MemorySystemName(MemorySystem system) {
+    switch (system) {
+        case MemorySystem::Box2D: return "box2d";
+        case MemorySystem::Entities: return "entities";
+        case MemorySystem::Debris: return "debris";
+        case MemorySystem::Render: return "render";
+        default: return "unknown";
+    }
+}
+
+void InstallBox2DAllocator() {
+    // Blocks from Box2D's default allocator could not be freed through ours,
+    // so the allocator is swapped once, before any world exists
+    static bool installed = false;
+    if (installed) return;
+    installed = true;
+    b2SetAllocator(Box2DAlloc, Box2DFree);
+}
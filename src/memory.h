@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Owners of tracked memory, reported separately in the HUD and headless output
+enum class MemorySystem : int {
+    Box2D,     // Everything Box2D allocates, routed through b2SetAllocator
+    Entities,  // Ball and brick arrays, transform history and the body pool
+    Debris,    // Settle tracking of broken bricks
+    Render,    // Render frames, instance and vertex arrays, the light field
+    Count
+};
+
+// Totals of one system; bytes goes down on every free, only the allocation
+// and free counts never decrease
+struct MemoryCounters {
+    int64_t bytes = 0;        // Currently allocated
+    int64_t peakBytes = 0;    // Highest bytes since the last ResetMemoryPeaks
+    int64_t allocations = 0;  // Allocations made so far
+    int64_t frees = 0;
+};
+
+static constexpr int MEMORY_SYSTEM_COUNT = (int)MemorySystem::Count;
+
+// Counters are atomic, Box2D's workers and the simulation thread may allocate
+// while the render thread reads them
+void TrackAllocation(MemorySystem system, size_t size);
+void TrackFree(MemorySystem system, size_t size);
+MemoryCounters ReadMemory(MemorySystem system);
+
+// Restart every system's peak from its current bytes
+void ResetMemoryPeaks();
+
+const char* MemorySystemName(MemorySystem system);
+
+// Route Box2D's allocations through the tracker
+// Must run before the first world is created, later calls do nothing
+void InstallBox2DAllocator();
+
+// Standard allocator that counts its blocks against a system
+template <typename T, MemorySystem System>
+struct TrackedAllocator {
+    using value_type = T;
+
+    template <typename U>
+    struct rebind { using other = TrackedAllocator<U, System>; };
+
+    TrackedAllocator() = default;
+    template <typename U>
+    TrackedAllocator(const TrackedAllocator<U, System>&) {}
+
+    T* allocate(size_t count) {
+        T* memory = std::allocator<T>().allocate(count);
+        TrackAllocation(System, count * sizeof(T));
+        return memory;
+    }
+
+    void deallocate(T* memory, size_t count) {
+        TrackFree(System, count * sizeof(T));
+        std::allocator<T>().deallocate(memory, count);
+    }
+
+    template <typename U>
+    bool operator==(const TrackedAllocator<U, System>&) const { return true; }
+    template <typename U>
+    bool operator!=(const TrackedAllocator<U, System>&) const { return false; }
+};
+
+template <typename T, MemorySystem System>
+using TrackedVector = std::vector<T, TrackedAllocator<T, System>>;
@@ -0,0 +1,80 @@
+#include "pipeline.h"
+#include "game.h"
+#include "profiler.h"
+
+FramePipeline::FramePipeline(Game& game, bool threaded)
+    : game(game)
+    , threaded(threaded)
+{
+    // The first frame drawn shows the world before any input
+    game.PrepareFrame();
+    game.SwapFrames();
+    
+    if (threaded) {
+        thread = std::thread(&FramePipeline::SimulationMain, this);
+    }
+}
+
+FramePipeline::~FramePipeline() {
+    if (!thread.joinable()) return;
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    thread.join();
+}
+
+void FramePipeline::Simulate(const FrameInput& input) {
+    game.ApplyQuality(input.quality);
+    game.ApplyInput(input.buttons);
+    game.Update(input.frameTime);
+    game.PrepareFrame();
+}
+
+void FramePipeline::RunFrame(const FrameInput& input) {
+    if (!threaded) {
+        Simulate(input);
+        game.SwapFrames();
+        game.Render();
+        game.GetProfiler().EndFrame();
+        return;
+    }
+    
+    // Hand the input to the simulation thread, which prepares the back frame
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending = input;
+        hasWork = true;
+    }
+    wake.notify_one();
+    
+    // Meanwhile draw the front frame, which the simulation never writes
+    game.Render();
+    
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return !hasWork; });
+    }
+    
+    // Both threads are idle, the prepared frame becomes the next one drawn
+    game.SwapFrames();
+    game.GetProfiler().EndFrame();
+}
+
+void FramePipeline::SimulationMain() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wake.wait(lock, [this] { return hasWork || stopping; });
+        if (stopping) return;
+        
+        FrameInput input = pending;
+        lock.unlock();
+        Simulate(input);
+        lock.lock();
+        
+        hasWork = false;
+        done.notify_one();
+    }
+}
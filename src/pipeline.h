@@ -0,0 +1,45 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "input_recording.h"
+
+class Game;
+
+// Runs the frames of a windowed Game
+// Serially, each frame applies its input, updates, prepares and draws. When
+// threaded, a simulation thread applies the input, updates and prepares the
+// next frame while this thread draws the last prepared one, so a frame takes
+// about as long as the slower of the two instead of their sum. Input then
+// reaches the screen one frame later.
+class FramePipeline {
+public:
+    // Prepares the first frame from the world as it is
+    FramePipeline(Game& game, bool threaded);
+    ~FramePipeline();
+
+    FramePipeline(const FramePipeline&) = delete;
+    FramePipeline& operator=(const FramePipeline&) = delete;
+
+    // Simulate one frame of input and draw, then close the profiler frame
+    // Input must have been polled while no frame was running
+    void RunFrame(const FrameInput& input);
+    
+    bool IsThreaded() const { return threaded; }
+
+private:
+    Game& game;
+    bool threaded;
+    
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;  // Work was queued or the pipeline is stopping
+    std::condition_variable done;  // The queued work finished
+    FrameInput pending;
+    bool hasWork = false;
+    bool stopping = false;
+
+    void Simulate(const FrameInput& input);
+    void SimulationMain();
+};
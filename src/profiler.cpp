@@ -0,0 +1,191 @@
+#include "profiler.h"
+#include <box2d/box2d.h>
+#include <cstdio>
+
+static constexpr int BOX2D_ZONE_COUNT = Profiler::ZONE_COUNT - (int)ProfileZone::B2Pairs;
+
+// Trace lane of a zone: simulation work on one, input and drawing on the other,
+// matching the threads of a pipelined run
+static int ZoneLane(ProfileZone zone) {
+    switch (zone) {
+        case ProfileZone::Update:
+        case ProfileZone::Step:
+        case ProfileZone::Breaks:
+        case ProfileZone::Shards:
+        case ProfileZone::Stream:
+        case ProfileZone::Prepare:
+        case ProfileZone::Lighting:
+            return 2;
+        default:
+            return 1;
+    }
+}
+
+Profiler::Profiler()
+    : origin(Clock::now()), frameStart(origin)
+{
+    for (std::vector<double>& samples : history) {
+        samples.assign(HISTORY_FRAMES, 0.0);
+    }
+    for (int i = 0; i < MEMORY_SYSTEM_COUNT; i++) {
+        allocationMarks[i] = ReadMemory((MemorySystem)i).allocations;
+    }
+}
+
+Profiler::~Profiler() {
+    // Keep a partial capture, a headless run may end before the window is full
+    if (IsCapturing()) FinishCapture();
+}
+
+int64_t Profiler::MicrosecondsSinceOrigin(Clock::time_point time) const {
+    return std::chrono::duration_cast<std::chrono::microseconds>(time - origin).count();
+}
+
+void Profiler::Record(ProfileZone zone, Clock::time_point start, Clock::time_point end) {
+    current[(int)zone] += std::chrono::duration<double, std::milli>(end - start).count();
+
+    if (captureFramesLeft > 0) {
+        TraceEvent event;
+        event.startUs = MicrosecondsSinceOrigin(start);
+        event.durationUs = (int32_t)std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+        event.zone = (uint8_t)zone;
+        
+        std::lock_guard<std::mutex> lock(traceMutex);
+        traceEvents.push_back(event);
+    }
+}
+
+void Profiler::AddBox2DProfile(const b2Profile& profile) {
+    // Box2D reports milliseconds already, continuous collision is its "bullets" stage
+    current[(int)ProfileZone::B2Pairs] += profile.pairs;
+    current[(int)ProfileZone::B2Collide] += profile.collide;
+    current[(int)ProfileZone::B2Solve] += profile.solve;
+    current[(int)ProfileZone::B2Continuous] += profile.bullets;
+    current[(int)ProfileZone::B2Refit] += profile.refit;
+    current[(int)ProfileZone::B2Sleep] += profile.sleepIslands;
+}
+
+void Profiler::EndFrame() {
+    Clock::time_point now = Clock::now();
+    Record(ProfileZone::Frame, frameStart, now);
+    frameStart = now;
+
+    if (captureFramesLeft > 0) {
+        TraceCounters counters;
+        counters.timeUs = MicrosecondsSinceOrigin(now);
+        for (int i = 0; i < BOX2D_ZONE_COUNT; i++) {
+            counters.box2d[i] = (float)current[(int)ProfileZone::B2Pairs + i];
+        }
+        traceCounters.push_back(counters);
+
+        if (--captureFramesLeft == 0) FinishCapture();
+    }
+
+    for (int i = 0; i < ZONE_COUNT; i++) {
+        history[i][historyHead] = current[i];
+        current[i] = 0.0;
+    }
+    historyHead = (historyHead + 1) % HISTORY_FRAMES;
+    if (historyCount < HISTORY_FRAMES) historyCount++;
+    
+    // Counters are process-wide, a frame's share is the growth since the last mark
+    for (int i = 0; i < MEMORY_SYSTEM_COUNT; i++) {
+        int64_t allocations = ReadMemory((MemorySystem)i).allocations;
+        frameAllocations[i] = allocations - allocationMarks[i];
+        allocationMarks[i] = allocations;
+    }
+}
+
+double Profiler::LastFrameMs(ProfileZone zone) const {
+    if (historyCount == 0) return 0.0;
+    int last = (historyHead + HISTORY_FRAMES - 1) % HISTORY_FRAMES;
+    return history[(int)zone][last];
+}
+
+SampleSummary Profiler::Summary(ProfileZone zone) const {
+    // Until the ring fills, only the frames recorded so far count
+    const std::vector<double>& samples = history[(int)zone];
+    if (historyCount < HISTORY_FRAMES) {
+        return Summarize(std::vector<double>(samples.begin(), samples.begin() + historyCount));
+    }
+    return Summarize(samples);
+}
+
+void Profiler::BeginCapture(const std::string& path, int frameCount) {
+    if (IsCapturing()) FinishCapture();
+    if (frameCount <= 0) return;
+
+    capturePath = path;
+    captureFramesLeft = frameCount;
+    traceEvents.clear();
+    traceCounters.clear();
+
+    // Roughly a dozen scopes per frame, reserve so capturing does not reallocate mid-frame
+    traceEvents.reserve((size_t)frameCount * 16);
+    traceCounters.reserve((size_t)frameCount);
+}
+
+void Profiler::FinishCapture() {
+    captureFramesLeft = 0;
+
+    FILE* file = fopen(capturePath.c_str(), "w");
+    if (!file) {
+        fprintf(stderr, "profiler: cannot write trace %s\n", capturePath.c_str());
+        return;
+    }
+
+    // Chrome trace event format: complete ("X") events for the scopes and
+    // counter ("C") events for the Box2D breakdown, one per frame
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    fprintf(file, "  {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"raycode\"}},\n");
+    fprintf(file, "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 1, \"args\": {\"name\": \"render\"}},\n");
+    fprintf(file, "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 2, \"args\": {\"name\": \"simulation\"}}");
+
+    for (const TraceEvent& event : traceEvents) {
+        fprintf(file, ",\n  {\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %lld, \"dur\": %d}",
+            ZoneName((ProfileZone)event.zone), ZoneLane((ProfileZone)event.zone),
+            (long long)event.startUs, (int)event.durationUs);
+    }
+
+    for (const TraceCounters& counters : traceCounters) {
+        fprintf(file, ",\n  {\"name\": \"box2d\", \"ph\": \"C\", \"pid\": 1, \"ts\": %lld, \"args\": {",
+            (long long)counters.timeUs);
+        for (int i = 0; i < BOX2D_ZONE_COUNT; i++) {
+            fprintf(file, "%s\"%s\": %.4f", i > 0 ? ", " : "",
+                ZoneName((ProfileZone)((int)ProfileZone::B2Pairs + i)), counters.box2d[i]);
+        }
+        fprintf(file, "}}");
+    }
+
+    fprintf(file, "\n]}\n");
+    fclose(file);
+
+    traceEvents.clear();
+    traceCounters.clear();
+}
+
+const char* Profiler::ZoneName(ProfileZone zone) {
+    switch (zone) {
+        case ProfileZone::Frame: return "frame";
+        case ProfileZone::Input: return "input";
+        case ProfileZone::Update: return "update";
+        case ProfileZone::Step: return "step";
+        case ProfileZone::Breaks: return "breaks";
+        case ProfileZone::Shards: return "shards";
+        case ProfileZone::Stream: return "stream";
+        case ProfileZone::Background: return "background";
+        case ProfileZone::Prepare: return "prepare";
+        case ProfileZone::Lighting: return "lighting";
+        case ProfileZone::Entities: return "entities";
+        case ProfileZone::Hud: return "hud";
+        case ProfileZone::Present: return "present";
+        case ProfileZone::Latency: return "input latency";
+        case ProfileZone::B2Pairs: return "b2 pairs";
+        case ProfileZone::B2Collide: return "b2 collide";
+        case ProfileZone::B2Solve: return "b2 solve";
+        case ProfileZone::B2Continuous: return "b2 continuous";
+        case ProfileZone::B2Refit: return "b2 refit";
+        case ProfileZone::B2Sleep: return "b2 sleep";
+        default: return "unknown";
+    }
+}
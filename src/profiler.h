@@ -0,0 +1,135 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "stats.h"
+#include "memory.h"
+
+struct b2Profile;
+
+// Phases of a frame timed by the profiler
+// The Box2D entries are copied from b2World_GetProfile rather than timed here
+enum class ProfileZone : int {
+    Frame,       // Time between two EndFrame calls
+    Input,
+    Update,
+    Step,        // b2World_Step
+    Breaks,      // Brick break dispatch
+    Shards,      // Moving bodies between shards and updating their ghosts
+    Stream,      // Encoding and sending the spectator stream
+    Background,
+    Prepare,     // Copying the visible world into a render frame
+    Lighting,    // Lightmap updates and ball lighting, inside Prepare
+    Entities,    // Drawing balls and bricks
+    Hud,
+    Present,     // EndDrawing, including the buffer swap
+    Latency,     // Input applied to the end of the EndDrawing that shows it, spans frames
+    B2Pairs,
+    B2Collide,
+    B2Solve,
+    B2Continuous,
+    B2Refit,
+    B2Sleep,
+    Count
+};
+
+// Collects per-frame zone times for the HUD and can capture a window of frames
+// as a Chrome trace (load the file in chrome://tracing or ui.perfetto.dev)
+// A scope costs two clock reads. Zones may be recorded from the simulation
+// and render threads at once, each zone from one thread only; EndFrame,
+// BeginCapture and the queries belong to the thread running the frame loop
+class Profiler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr int ZONE_COUNT = (int)ProfileZone::Count;
+    static constexpr int HISTORY_FRAMES = 120;  // Frames kept for rolling statistics
+
+    Profiler();
+    ~Profiler();
+
+    // Add a timed interval to the current frame
+    void Record(ProfileZone zone, Clock::time_point start, Clock::time_point end);
+
+    // Add one physics step's Box2D breakdown to the current frame
+    void AddBox2DProfile(const b2Profile& profile);
+
+    // Close the current frame: push its totals into the history and the capture
+    void EndFrame();
+
+    // Milliseconds spent in a zone so far this frame
+    double FrameMs(ProfileZone zone) const { return current[(int)zone]; }
+
+    // Milliseconds spent in a zone during the last completed frame
+    double LastFrameMs(ProfileZone zone) const;
+
+    // Statistics of a zone over the last HISTORY_FRAMES frames
+    SampleSummary Summary(ProfileZone zone) const;
+    
+    // Tracked allocations a system made during the last completed frame
+    int64_t FrameAllocations(MemorySystem system) const { return frameAllocations[(int)system]; }
+
+    // Record the next frameCount frames and write them to path as a trace
+    // Any capture still running is written out first
+    void BeginCapture(const std::string& path, int frameCount);
+    bool IsCapturing() const { return captureFramesLeft > 0; }
+
+    static const char* ZoneName(ProfileZone zone);
+
+private:
+    // One timed interval of a captured frame, in microseconds since the profiler started
+    struct TraceEvent {
+        int64_t startUs;
+        int32_t durationUs;
+        uint8_t zone;
+    };
+
+    // Box2D breakdown of a captured frame, written as counter events
+    struct TraceCounters {
+        int64_t timeUs;
+        float box2d[ZONE_COUNT - (int)ProfileZone::B2Pairs];
+    };
+
+    Clock::time_point origin;
+    Clock::time_point frameStart;
+    double current[ZONE_COUNT] = {};
+    std::vector<double> history[ZONE_COUNT];  // Ring buffers of frame totals
+    int historyHead = 0;
+    int historyCount = 0;
+    
+    int64_t frameAllocations[MEMORY_SYSTEM_COUNT] = {};
+    int64_t allocationMarks[MEMORY_SYSTEM_COUNT] = {};  // Allocation counts at the last EndFrame
+
+    std::string capturePath;
+    int captureFramesLeft = 0;
+    std::vector<TraceEvent> traceEvents;
+    std::mutex traceMutex;  // Zones may be recorded by the simulation and render threads at once
+    std::vector<TraceCounters> traceCounters;
+
+    int64_t MicrosecondsSinceOrigin(Clock::time_point time) const;
+    void FinishCapture();
+};
+
+// Times the enclosing block into a profiler zone
+class ProfileScope {
+public:
+    ProfileScope(Profiler& profiler, ProfileZone zone)
+        : profiler(profiler), zone(zone), start(Profiler::Clock::now())
+    {
+    }
+
+    ~ProfileScope() {
+        profiler.Record(zone, start, Profiler::Clock::now());
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    Profiler& profiler;
+    ProfileZone zone;
+    Profiler::Clock::time_point start;
+};
@@ -0,0 +1,62 @@
+#include "quality_governor.h"
+#include <algorithm>
+
+QualityGovernor::QualityGovernor(float budgetMs)
+    : budgetMs(std::max(budgetMs, 0.0f))
+{
+}
+
+void QualityGovernor::Observe(double updateMs) {
+    if (!IsEnabled()) return;
+
+    average += (updateMs - average) * SMOOTHING;
+    if (holdFrames > 0) {
+        holdFrames--;
+        return;
+    }
+
+    // A single frame over the budget already missed, so it counts on its own;
+    // otherwise the average must be close to the budget
+    if (updateMs > budgetMs || average > budgetMs * DANGER) {
+        calmFrames = 0;
+        if (level + 1 < LEVEL_COUNT) {
+            level++;
+            holdFrames = HOLD_FRAMES;
+        }
+        return;
+    }
+
+    calmFrames = average < budgetMs * HEADROOM ? calmFrames + 1 : 0;
+    if (calmFrames >= CALM_FRAMES && level > 0) {
+        level--;
+        calmFrames = 0;
+        holdFrames = HOLD_FRAMES;
+    }
+}
+
+PhysicsQuality QualityGovernor::AtLevel(const PhysicsQuality& full, int level) {
+    level = std::clamp(level, 0, LEVEL_COUNT - 1);
+
+    // Each level drops a quarter of the substeps, rounded up, and halves the
+    // debris that may keep moving and how long it may rest before retiring
+    PhysicsQuality quality = full;
+    int kept = LEVEL_COUNT - level;
+    quality.subStepCount = std::max((full.subStepCount * kept + LEVEL_COUNT - 1) / LEVEL_COUNT, 1);
+    quality.debrisSettleSteps = std::max(full.debrisSettleSteps >> level, 1);
+    quality.maxActiveDebris = full.maxActiveDebris >> level;
+
+    // Box2D only runs continuous collision for bodies fast enough to tunnel,
+    // the lowest levels accept that risk
+    quality.continuous = full.continuous && level < 2;
+    return quality;
+}
+
+const char* QualityGovernor::LevelName(int level) {
+    switch (level) {
+        case 0: return "full";
+        case 1: return "reduced";
+        case 2: return "low";
+        case 3: return "minimal";
+        default: return "unknown";
+    }
+}
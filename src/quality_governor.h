@@ -0,0 +1,49 @@
+#pragma once
+
+// Physics settings the governor trades for time, see QualityGovernor
+struct PhysicsQuality {
+    int subStepCount = 4;       // Box2D substeps per physics step
+    int debrisSettleSteps = 1;  // Physics steps debris rests before it is retired
+    int maxActiveDebris = 0;    // Moving debris allowed before the oldest is retired
+    bool continuous = true;     // Continuous collision of fast bodies against static ones
+};
+
+// Watches the update time of frames against a budget and picks a physics
+// quality level: when a frame comes close to the budget, the next frames
+// run with fewer substeps, less moving debris and eventually without
+// continuous collision; once frames have run well within the budget for a
+// while, quality comes back one level at a time
+// The governor only recommends a level, the frame input carries the level
+// a frame actually ran at so that recordings replay the same simulation
+class QualityGovernor {
+public:
+    // budgetMs is the update time a frame may take, 0 keeps full quality
+    explicit QualityGovernor(float budgetMs);
+
+    // Feed the update time of a frame that ran physics steps
+    void Observe(double updateMs);
+
+    // Level the next frame should run at, 0 is full quality
+    int Level() const { return level; }
+    float BudgetMs() const { return budgetMs; }
+    bool IsEnabled() const { return budgetMs > 0.0f; }
+
+    // The settings of a level, scaled down from those of full quality
+    static PhysicsQuality AtLevel(const PhysicsQuality& full, int level);
+    static const char* LevelName(int level);
+
+    static constexpr int LEVEL_COUNT = 4;  // full, reduced, low, minimal
+
+private:
+    float budgetMs;
+    double average = 0.0;  // Smoothed update time
+    int level = 0;
+    int holdFrames = 0;    // Frames left before the level may change again
+    int calmFrames = 0;    // Consecutive frames well within the budget
+
+    static constexpr double SMOOTHING = 0.2;     // Weight of the newest frame in the average
+    static constexpr double DANGER = 0.85;       // Fraction of the budget that lowers quality
+    static constexpr double HEADROOM = 0.5;      // Fraction of the budget that counts as calm
+    static constexpr int HOLD_FRAMES = 15;       // Settling time after a change
+    static constexpr int CALM_FRAMES = 60;       // Calm frames needed to raise quality a level
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+
+// Small seeded generator (PCG32) so every game owns its own random stream
+// Unlike raylib's GetRandomValue the sequence only depends on the seed, which
+// is what makes recorded sessions replay identically
+class Random {
+public:
+    explicit Random(uint64_t seed = 1) {
+        Seed(seed);
+    }
+
+    void Seed(uint64_t seed) {
+        state = 0;
+        Next();
+        state += seed;
+        Next();
+    }
+
+    uint32_t Next() {
+        uint64_t old = state;
+        state = old * 6364136223846793005ULL + INCREMENT;
+        uint32_t xorShifted = (uint32_t)(((old >> 18u) ^ old) >> 27u);
+        uint32_t rotation = (uint32_t)(old >> 59u);
+        return (xorShifted >> rotation) | (xorShifted << ((0u - rotation) & 31u));
+    }
+
+    // Random integer between min and max, both included, like GetRandomValue
+    int Range(int min, int max) {
+        if (max < min) {
+            int swap = min;
+            min = max;
+            max = swap;
+        }
+        uint32_t span = (uint32_t)((int64_t)max - (int64_t)min + 1);
+        if (span == 0) return (int)Next();  // The whole int range
+        return min + (int)(Next() % span);
+    }
+
+    // Full generator state, for snapshots
+    uint64_t State() const { return state; }
+    void State(uint64_t value) { state = value; }
+
+private:
+    static constexpr uint64_t INCREMENT = 1442695040888963407ULL;
+    uint64_t state = 0;
+};
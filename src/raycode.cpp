@@ -1,25 +1,345 @@
 ﻿// raycode.cpp : Defines the entry point for the application.
 //
 #include "raycode.h"
+#include "headless.h"
+#include "scene.h"
+#include "profiler.h"
+#include "input_recording.h"
+#include "snapshot.h"
+#include "pipeline.h"
+#include "frame_pacer.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
 using namespace std;
 
-int main()
+static void PrintUsage()
 {
-    unique_ptr<Game> game = make_unique<Game>();
+    printf("usage: raycode [--workers N] [--shards N] [--sim-rate HZ] [--seed N] [--frame-budget MS]\n");
+    printf("               [--scene wall-grid|ball-swarm|full-shatter|FILE] [--entities N]\n");
+    printf("               [--export-scene FILE] [--trace FILE [--trace-frames N]]\n");
+    printf("               [--record FILE] [--replay FILE] [--snapshot FILE] [--save-snapshot FILE]\n");
+    printf("               [--pipelined] [--pacing capped|vsync|uncapped] [--low-latency]\n");
+    printf("               [--no-shadows] [--stream PORT]\n");
+    printf("               [--headless [--frames N] [--threads N,N,...] [--prepare]]\n");
+}
+
+// Parse a comma separated list of positive counts such as "1,2,4,8"
+static bool ParseCountList(const char* text, vector<int>& counts)
+{
+    counts.clear();
+    while (*text)
+    {
+        char* end = nullptr;
+        long value = strtol(text, &end, 10);
+        if (end == text || value <= 0) return false;
+
+        if (*end != ',' && *end != '\0') return false;
+
+        counts.push_back((int)value);
+        text = (*end == ',') ? end + 1 : end;
+    }
+    return !counts.empty();
+}
+
+int main(int argc, char** argv)
+{
+    bool headless = false;
+    HeadlessOptions headlessOptions;
+    GameConfig config;
+    bool threadListGiven = false;
+    const char* exportPath = nullptr;
+    const char* recordPath = nullptr;
+    bool seedGiven = false;
+    bool pipelined = false;
+    PacingMode pacing = PacingMode::Capped;
+    bool lowLatency = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (strcmp(arg, "--headless") == 0)
+        {
+            headless = true;
+        }
+        else if (strcmp(arg, "--prepare") == 0)
+        {
+            headlessOptions.prepareFrames = true;
+        }
+        else if (strcmp(arg, "--frames") == 0 && hasValue)
+        {
+            headlessOptions.frames = atoi(argv[++i]);
+        }
+        else if (strcmp(arg, "--seed") == 0 && hasValue)
+        {
+            config.seed = (unsigned int)strtoul(argv[++i], nullptr, 10);
+            seedGiven = true;
+        }
+        else if (strcmp(arg, "--scene") == 0 && hasValue)
+        {
+            headlessOptions.scene = argv[++i];
+        }
+        else if (strcmp(arg, "--entities") == 0 && hasValue)
+        {
+            headlessOptions.entityCount = atoi(argv[++i]);
+        }
+        else if (strcmp(arg, "--export-scene") == 0 && hasValue)
+        {
+            exportPath = argv[++i];
+        }
+        else if (strcmp(arg, "--trace") == 0 && hasValue)
+        {
+            headlessOptions.tracePath = argv[++i];
+        }
+        else if (strcmp(arg, "--trace-frames") == 0 && hasValue)
+        {
+            headlessOptions.traceFrames = atoi(argv[++i]);
+        }
+        else if (strcmp(arg, "--record") == 0 && hasValue)
+        {
+            recordPath = argv[++i];
+        }
+        else if (strcmp(arg, "--replay") == 0 && hasValue)
+        {
+            // Replays always run headless, as fast as the machine allows
+            headlessOptions.replayPath = argv[++i];
+            headless = true;
+        }
+        else if (strcmp(arg, "--snapshot") == 0 && hasValue)
+        {
+            headlessOptions.snapshotPath = argv[++i];
+        }
+        else if (strcmp(arg, "--save-snapshot") == 0 && hasValue)
+        {
+            headlessOptions.saveSnapshotPath = argv[++i];
+        }
+        else if (strcmp(arg, "--pipelined") == 0)
+        {
+            pipelined = true;
+        }
+        else if (strcmp(arg, "--pacing") == 0 && hasValue)
+        {
+            if (!FramePacer::ParseMode(argv[++i], pacing))
+            {
+                PrintUsage();
+                return 1;
+            }
+        }
+        else if (strcmp(arg, "--low-latency") == 0)
+        {
+            lowLatency = true;
+        }
+        else if (strcmp(arg, "--no-shadows") == 0)
+        {
+            config.shadows = false;
+        }
+        else if (strcmp(arg, "--stream") == 0 && hasValue)
+        {
+            config.streamPort = atoi(argv[++i]);
+            if (config.streamPort <= 0 || config.streamPort > 65535)
+            {
+                PrintUsage();
+                return 1;
+            }
+        }
+        else if (strcmp(arg, "--workers") == 0 && hasValue)
+        {
+            config.workerCount = atoi(argv[++i]);
+        }
+        else if (strcmp(arg, "--frame-budget") == 0 && hasValue)
+        {
+            config.frameBudgetMs = (float)atof(argv[++i]);
+            if (config.frameBudgetMs < 0.0f)
+            {
+                PrintUsage();
+                return 1;
+            }
+        }
+        else if (strcmp(arg, "--shards") == 0 && hasValue)
+        {
+            config.shardCount = atoi(argv[++i]);
+            if (config.shardCount <= 0)
+            {
+                PrintUsage();
+                return 1;
+            }
+        }
+        else if (strcmp(arg, "--sim-rate") == 0 && hasValue)
+        {
+            config.simRate = (float)atof(argv[++i]);
+            if (config.simRate <= 0.0f)
+            {
+                PrintUsage();
+                return 1;
+            }
+        }
+        else if (strcmp(arg, "--threads") == 0 && hasValue)
+        {
+            if (!ParseCountList(argv[++i], headlessOptions.workerCounts))
+            {
+                PrintUsage();
+                return 1;
+            }
+            threadListGiven = true;
+        }
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    // Interactive sessions differ from run to run unless a seed is given,
+    // recordings store the seed they ended up with
+    if (!headless && !exportPath && !seedGiven)
+    {
+        config.seed = (unsigned int)time(nullptr);
+    }
+
+    // Presets draw from their own random stream so the game's stays untouched
+    Random sceneRandom(config.seed);
+
+    // Write a preset (or a re-saved file) out as a scene file and stop
+    if (exportPath)
+    {
+        Scene scene;
+        string error;
+        if (headlessOptions.scene.empty())
+        {
+            scene = MakeDefaultScene(800.0f, 600.0f, sceneRandom);
+        }
+        else if (!ResolveScene(headlessOptions.scene, headlessOptions.entityCount, sceneRandom, scene, error))
+        {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        return SaveScene(exportPath, scene) ? 0 : 1;
+    }
+
+    if (headless)
+    {
+        if (!threadListGiven)
+        {
+            headlessOptions.workerCounts = { config.workerCount };
+        }
+        headlessOptions.config = config;
+        return RunHeadless(headlessOptions);
+    }
+
+    // A recording rebuilds its world from the seed and scene, which a snapshot does not have
+    if (recordPath && !headlessOptions.snapshotPath.empty())
+    {
+        fprintf(stderr, "cannot record a session resumed from a snapshot\n");
+        return 1;
+    }
+
+    // Low latency samples input right before the step, which pipelining defers by a frame
+    if (lowLatency && pipelined)
+    {
+        fprintf(stderr, "--low-latency cannot be combined with --pipelined\n");
+        return 1;
+    }
+
+    unique_ptr<Game> game;
+    if (!headlessOptions.snapshotPath.empty())
+    {
+        MappedFile snapshotFile;
+        WorldSnapshot snapshot;
+        string error;
+        if (!snapshotFile.Open(headlessOptions.snapshotPath.c_str(), error)
+            || !ViewSnapshot(snapshotFile.Data(), snapshotFile.Size(), snapshot, error))
+        {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        game = make_unique<Game>(config, snapshot);
+    }
+    else if (headlessOptions.scene.empty())
+    {
+        game = make_unique<Game>(config);
+    }
+    else
+    {
+        Scene scene;
+        string error;
+        if (!ResolveScene(headlessOptions.scene, headlessOptions.entityCount, sceneRandom, scene, error))
+        {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        game = make_unique<Game>(config, scene);
+    }
+
+    FramePacer pacer(pacing, game->TargetFps(), lowLatency);
+    pacer.ConfigureWindow();
 
     InitWindow(
         game->ScreenWidth(),
         game->ScreenHeight(),
         "Stupid Ball Game!");
 
-    SetTargetFPS(game->TargetFps());
+    pacer.Start();
+    
+    // Capture the opening frames when a trace was asked for on the command line
+    if (!headlessOptions.tracePath.empty())
+    {
+        game->GetProfiler().BeginCapture(headlessOptions.tracePath, headlessOptions.traceFrames);
+    }
+
+    // Record the exact frame times and buttons the simulation saw, so the
+    // session can be replayed headless with --replay
+    InputRecorder recorder;
+    if (recordPath && !recorder.Open(recordPath, config, headlessOptions.scene, headlessOptions.entityCount))
+    {
+        return 1;
+    }
+
+    // Pipelined runs step the next frame on a simulation thread while this
+    // thread draws; the pipeline is stopped before the world is read below
+    {
+        FramePipeline pipeline(*game, pipelined);
+        while (game->IsRunning())
+        {
+            // Presses, wheel and drag since the last frame, as EndDrawing polled them
+            FrameInput input;
+            input.buttons = game->PollInput();
+
+            // Low latency sleeps here instead of after the last present; the
+            // poll after it only holds what arrived during the sleep, so both
+            // polls are read and the held buttons are taken from the later
+            if (pacer.WaitForInput())
+            {
+                PollInputEvents();
+                uint8_t pressed = input.buttons & INPUT_EXIT;
+                input.buttons = pressed | game->PollInput();
+            }
+            input.frameTime = GetFrameTime();
+
+            // Chosen from the frames before, while no frame runs, and recorded
+            // because it depends on how fast this machine ran them
+            input.quality = (uint8_t)game->GovernedQuality();
+            recorder.Record(input);
+
+            pipeline.RunFrame(input);
+            pacer.FramePresented(game->PresentStart());
+        }
+    }
+
+    // The final state lets a replay prove it reproduced the session
+    if (recorder.IsOpen())
+    {
+        recorder.Finish(game->StateHash());
+    }
 
-    while (game->IsRunning())
+    if (!headlessOptions.saveSnapshotPath.empty())
     {
-        game->ProcessInput();
-        game->Update();
-        game->Render();
+        game->SaveSnapshot(headlessOptions.saveSnapshotPath.c_str());
     }
 
+    // Release GPU resources while the window's GL context still exists
+    game.reset();
     CloseWindow();
 }
\ No newline at end of file
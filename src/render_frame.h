@@ -0,0 +1,34 @@
+#pragma once
+
+#include <raylib.h>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include "ball_renderer.h"
+#include "brick_batch.h"
+#include "FakeLight.h"
+
+// Everything needed to draw one frame, copied out of the simulation
+// Game keeps two: one is drawn while the other is prepared, so drawing
+// never reads the Box2D world or the entity stores
+struct RenderFrame {
+    Camera2D camera = {};         // View the frame was culled for
+    float worldWidth = 0.0f;      // Pixels
+    float worldHeight = 0.0f;
+    
+    BallInstances enemies;
+    BallInstances players;        // Drawn over the bricks
+    BrickBatch bricks;
+    TrackedVector<FakeLight, MemorySystem::Render> lights;
+    
+    // Shown by the HUD
+    int bodyCount = 0;
+    int contactCount = 0;
+    int drawnCount = 0;           // Balls and bricks the camera saw
+    uint64_t step = 0;            // Physics steps simulated when the frame was prepared
+    int qualityLevel = 0;         // Physics quality the steps ran at, see QualityGovernor
+    int subStepCount = 0;
+    
+    // When the input this frame shows was applied, for the latency measurement
+    std::chrono::steady_clock::time_point inputTime;
+};
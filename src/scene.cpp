@@ -0,0 +1,324 @@
+#include "scene.h"
+#include "random.h"
+#include "wall.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Palette used by the generated scenes
+static const Color SCENE_COLORS[] = { RED, BLUE, GREEN, YELLOW, ORANGE, PURPLE, SKYBLUE, PINK };
+static constexpr int SCENE_COLOR_COUNT = sizeof(SCENE_COLORS) / sizeof(SCENE_COLORS[0]);
+
+static constexpr float LIGHT_SPACING = 600.0f; // Distance between generated point lights
+
+int Scene::BrickCount() const {
+    int count = (int)bricks.size();
+    for (const Wall& wall : walls) {
+        count += wall.brickCount;
+    }
+    return count;
+}
+
+// Cursor over one line of a scene file
+// Parsing works in place on the loaded buffer, without streams or copies
+struct LineReader {
+    const char* cursor;
+    const char* end;
+    
+    void SkipSpaces() {
+        while (cursor < end && (*cursor == ' ' || *cursor == '\t' || *cursor == '\r')) cursor++;
+    }
+    
+    bool AtEnd() {
+        SkipSpaces();
+        return cursor >= end;
+    }
+    
+    bool Word(const char*& start, size_t& length) {
+        SkipSpaces();
+        start = cursor;
+        while (cursor < end && *cursor != ' ' && *cursor != '\t' && *cursor != '\r') cursor++;
+        length = (size_t)(cursor - start);
+        return length > 0;
+    }
+    
+    bool Is(const char* word) {
+        const char* start;
+        size_t length;
+        const char* saved = cursor;
+        if (Word(start, length) && length == strlen(word) && strncmp(start, word, length) == 0) return true;
+        cursor = saved;
+        return false;
+    }
+    
+    bool Float(float& value) {
+        SkipSpaces();
+        if (cursor >= end) return false;
+        char* next = nullptr;
+        value = strtof(cursor, &next);
+        if (next == cursor || next > end) return false;
+        cursor = next;
+        return true;
+    }
+    
+    bool Int(int& value) {
+        SkipSpaces();
+        if (cursor >= end) return false;
+        char* next = nullptr;
+        long parsed = strtol(cursor, &next, 10);
+        if (next == cursor || next > end) return false;
+        value = (int)parsed;
+        cursor = next;
+        return true;
+    }
+    
+    bool Rgb(Color& color) {
+        int r, g, b;
+        if (!Int(r) || !Int(g) || !Int(b)) return false;
+        color = Color{ (unsigned char)std::clamp(r, 0, 255), (unsigned char)std::clamp(g, 0, 255),
+                       (unsigned char)std::clamp(b, 0, 255), 255 };
+        return true;
+    }
+};
+
+static bool ParseLine(LineReader& line, Scene& scene) {
+    if (line.Is("size")) {
+        return line.Float(scene.width) && line.Float(scene.height) &&
+               scene.width > 0.0f && scene.height > 0.0f;
+    }
+    
+    if (line.Is("ball")) {
+        Scene::Ball ball{};
+        if (!line.Float(ball.x) || !line.Float(ball.y) || !line.Rgb(ball.color)) return false;
+        ball.player = line.Is("player");
+        scene.balls.push_back(ball);
+        return true;
+    }
+    
+    if (line.Is("wall")) {
+        Scene::Wall wall{};
+        if (!line.Float(wall.x) || !line.Float(wall.y) || !line.Int(wall.brickCount)) return false;
+        if (line.Is("h")) {
+            wall.horizontal = true;
+        } else if (line.Is("v")) {
+            wall.horizontal = false;
+        } else {
+            return false;
+        }
+        if (!line.Rgb(wall.color) || wall.brickCount <= 0) return false;
+        scene.walls.push_back(wall);
+        return true;
+    }
+    
+    if (line.Is("brick")) {
+        Scene::Brick brick{};
+        if (!line.Float(brick.x) || !line.Float(brick.y) || !line.Rgb(brick.color)) return false;
+        scene.bricks.push_back(brick);
+        return true;
+    }
+    
+    if (line.Is("light")) {
+        Scene::Light light{};
+        if (line.Is("point")) {
+            light.type = LightType::Point;
+        } else if (line.Is("directional")) {
+            light.type = LightType::Directional;
+        } else {
+            return false;
+        }
+        if (!line.Float(light.vector.x) || !line.Float(light.vector.y)) return false;
+        scene.lights.push_back(light);
+        return true;
+    }
+    
+    return false;
+}
+
+bool LoadScene(const char* path, Scene& scene, std::string& error) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        error = std::string("cannot open scene file ") + path;
+        return false;
+    }
+    
+    // Read the whole file at once, then parse it in place
+    std::string text;
+    char chunk[65536];
+    size_t read;
+    while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        text.append(chunk, read);
+    }
+    fclose(file);
+    
+    scene = Scene();
+    const char* cursor = text.data();
+    const char* end = cursor + text.size();
+    int lineNumber = 0;
+    
+    while (cursor < end) {
+        const char* lineEnd = (const char*)memchr(cursor, '\n', (size_t)(end - cursor));
+        if (!lineEnd) lineEnd = end;
+        lineNumber++;
+        
+        LineReader line{ cursor, lineEnd };
+        bool blank = line.AtEnd() || *line.cursor == '#';
+        
+        if (!blank && (!ParseLine(line, scene) || !line.AtEnd())) {
+            error = std::string(path) + ":" + std::to_string(lineNumber) + ": invalid scene line";
+            return false;
+        }
+        
+        cursor = lineEnd + 1;
+    }
+    
+    return true;
+}
+
+bool SaveScene(const char* path, const Scene& scene) {
+    FILE* file = fopen(path, "wb");
+    if (!file) return false;
+    
+    fprintf(file, "# raycode scene\n");
+    fprintf(file, "size %g %g\n", scene.width, scene.height);
+    for (const Scene::Light& light : scene.lights) {
+        fprintf(file, "light %s %g %g\n", light.type == LightType::Point ? "point" : "directional",
+            light.vector.x, light.vector.y);
+    }
+    for (const Scene::Wall& wall : scene.walls) {
+        fprintf(file, "wall %g %g %d %s %d %d %d\n", wall.x, wall.y, wall.brickCount,
+            wall.horizontal ? "h" : "v", wall.color.r, wall.color.g, wall.color.b);
+    }
+    for (const Scene::Brick& brick : scene.bricks) {
+        fprintf(file, "brick %g %g %d %d %d\n", brick.x, brick.y,
+            brick.color.r, brick.color.g, brick.color.b);
+    }
+    for (const Scene::Ball& ball : scene.balls) {
+        fprintf(file, "ball %g %g %d %d %d%s\n", ball.x, ball.y,
+            ball.color.r, ball.color.g, ball.color.b, ball.player ? " player" : "");
+    }
+    
+    bool ok = ferror(file) == 0;
+    fclose(file);
+    return ok;
+}
+
+Scene MakeDefaultScene(float width, float height, Random& random) {
+    Scene scene;
+    scene.width = width;
+    scene.height = height;
+    
+    // Create player
+    scene.balls.push_back(Scene::Ball{ 100.0f, 100.0f, WHITE, true });
+    
+    // Create 5 enemies with random positions and predefined colors
+    Color enemyColors[] = { RED, BLUE, GREEN, YELLOW, ORANGE };
+    
+    for (int i = 0; i < 5; i++) {
+        float x = 50 + (float)(random.Range(0, (int)width - 100));
+        float y = 50 + (float)(random.Range(0, (int)height - 100));
+        scene.balls.push_back(Scene::Ball{ x, y, enemyColors[i], false });
+    }
+    
+    // Create 2 brick walls with random lengths
+    int wall1Length = random.Range(8, 15);
+    int wall2Length = random.Range(8, 15);
+    
+    // Horizontal wall in middle-upper area
+    scene.walls.push_back(Scene::Wall{ 200.0f, 150.0f, wall1Length, true, BROWN });
+    
+    // Vertical wall in middle-right area
+    scene.walls.push_back(Scene::Wall{ 600.0f, 250.0f, wall2Length, false, GRAY });
+    
+    // Create point light at center of screen
+    scene.lights.push_back(Scene::Light{ LightType::Point, { width / 2.0f, height / 2.0f } });
+    
+    return scene;
+}
+
+// Square arena big enough for count items spaced by spacing pixels
+static void SizeArena(Scene& scene, int count, float spacing) {
+    float side = ceilf(sqrtf((float)std::max(count, 1))) * spacing + 2.0f * spacing;
+    scene.width = std::max(side, 800.0f);
+    scene.height = std::max(side, 600.0f);
+}
+
+// Point lights on a regular grid over the whole arena
+static void AddLightGrid(Scene& scene) {
+    for (float y = LIGHT_SPACING / 2.0f; y < scene.height; y += LIGHT_SPACING) {
+        for (float x = LIGHT_SPACING / 2.0f; x < scene.width; x += LIGHT_SPACING) {
+            scene.lights.push_back(Scene::Light{ LightType::Point, { x, y } });
+        }
+    }
+}
+
+// Balls at random positions inside the arena, the first one player-controlled
+static void AddRandomBalls(Scene& scene, int count, Random& random) {
+    for (int i = 0; i < count; i++) {
+        float x = 50 + (float)random.Range(0, (int)scene.width - 100);
+        float y = 50 + (float)random.Range(0, (int)scene.height - 100);
+        bool player = scene.balls.empty();
+        Color color = player ? WHITE : SCENE_COLORS[i % SCENE_COLOR_COUNT];
+        scene.balls.push_back(Scene::Ball{ x, y, color, player });
+    }
+}
+
+bool MakeStressScene(const std::string& name, int entityCount, Random& random, Scene& scene) {
+    scene = Scene();
+    entityCount = std::max(entityCount, 1);
+    
+    if (name == "wall-grid") {
+        // Rows of 12-brick walls alternating direction, one cell per wall,
+        // with roughly one ball per twenty walls to keep them breaking
+        const int bricksPerWall = 12;
+        const float cell = bricksPerWall * Wall::BRICK_SPACING + 60.0f;
+        int wallCount = std::max(entityCount / bricksPerWall, 1);
+        int columns = (int)ceilf(sqrtf((float)wallCount));
+        
+        scene.width = std::max(columns * cell + cell, 800.0f);
+        scene.height = std::max(columns * cell + cell, 600.0f);
+        
+        for (int i = 0; i < wallCount; i++) {
+            float x = cell / 2.0f + (i % columns) * cell + 30.0f;
+            float y = cell / 2.0f + (i / columns) * cell + 30.0f;
+            bool horizontal = ((i / columns) + i) % 2 == 0;
+            scene.walls.push_back(Scene::Wall{ x, y, bricksPerWall, horizontal,
+                                               i % 2 ? BROWN : GRAY });
+        }
+        
+        AddRandomBalls(scene, std::max(wallCount / 20, 2), random);
+    } else if (name == "ball-swarm") {
+        // Open arena packed with balls, about one per 60 pixel cell
+        SizeArena(scene, entityCount, 60.0f);
+        AddRandomBalls(scene, entityCount, random);
+    } else if (name == "full-shatter") {
+        // Every brick already loose, laid out as the walls they came from,
+        // with one ball for every ten bricks
+        int ballCount = std::max(entityCount / 10, 2);
+        int brickCount = std::max(entityCount - ballCount, 1);
+        SizeArena(scene, brickCount + ballCount, 40.0f);
+        
+        int bricksPerRow = std::max((int)((scene.width - 100.0f) / Wall::BRICK_SPACING), 1);
+        for (int i = 0; i < brickCount; i++) {
+            // Leave a 25 pixel gap between rows so balls can move between them
+            float x = 50.0f + (i % bricksPerRow) * Wall::BRICK_SPACING;
+            float y = 50.0f + (i / bricksPerRow) * (Wall::BRICK_SPACING + 25.0f);
+            if (y > scene.height - 50.0f) break;
+            scene.bricks.push_back(Scene::Brick{ x, y, i % 2 ? BROWN : GRAY });
+        }
+        
+        AddRandomBalls(scene, ballCount, random);
+    } else {
+        return false;
+    }
+    
+    AddLightGrid(scene);
+    return true;
+}
+
+bool ResolveScene(const std::string& nameOrPath, int entityCount, Random& random,
+                  Scene& scene, std::string& error) {
+    if (MakeStressScene(nameOrPath, entityCount, random, scene)) return true;
+    return LoadScene(nameOrPath.c_str(), scene, error);
+}
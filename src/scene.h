@@ -0,0 +1,72 @@
+#pragma once
+
+#include <raylib.h>
+#include <string>
+#include <vector>
+#include "FakeLight.h"
+
+class Random;
+
+// Everything needed to build a Game's world, in pixels
+// Scenes come from text files or from the procedural generators below
+struct Scene {
+    struct Ball {
+        float x, y;
+        Color color;
+        bool player;  // Player-controlled instead of auto-bouncing
+    };
+    
+    struct Wall {
+        float x, y;       // Centre of the first brick
+        int brickCount;
+        bool horizontal;
+        Color color;
+    };
+    
+    struct Brick {
+        float x, y;       // Loose brick, already broken off
+        Color color;
+    };
+    
+    struct Light {
+        LightType type;
+        Vector2 vector;   // Position of a point light, direction of a directional one
+    };
+    
+    float width = 800.0f;   // Size of the walled play area
+    float height = 600.0f;
+    std::vector<Ball> balls;
+    std::vector<Wall> walls;
+    std::vector<Brick> bricks;
+    std::vector<Light> lights;
+    
+    int BrickCount() const;  // Wall bricks plus loose bricks
+};
+
+// Load a scene file, one entity per line:
+//   size <width> <height>
+//   ball <x> <y> <r> <g> <b> [player]
+//   wall <x> <y> <bricks> <h|v> <r> <g> <b>
+//   brick <x> <y> <r> <g> <b>
+//   light point <x> <y>
+//   light directional <dx> <dy>
+// Blank lines and lines starting with '#' are ignored
+// Returns false and describes the problem in error if the file is invalid
+bool LoadScene(const char* path, Scene& scene, std::string& error);
+
+// Write a scene in the format read by LoadScene
+bool SaveScene(const char* path, const Scene& scene);
+
+// The original arena: player, five enemies, two random walls and a centred light
+Scene MakeDefaultScene(float width, float height, Random& random);
+
+// Stress scenes sized to roughly entityCount bodies:
+//   "wall-grid"    dense grid of intact walls with a few balls
+//   "ball-swarm"   thousands of balls in an open arena
+//   "full-shatter" every brick already broken loose among balls
+// Returns false if the name is unknown
+bool MakeStressScene(const std::string& name, int entityCount, Random& random, Scene& scene);
+
+// Build a scene from a preset name or, failing that, a scene file path
+bool ResolveScene(const std::string& nameOrPath, int entityCount, Random& random,
+                  Scene& scene, std::string& error);
@@ -0,0 +1,202 @@
+#include "sharded_world.h"
+#include "game.h"
+#include "task_scheduler.h"
+#include <algorithm>
+#include <cmath>
+
+// One physics step of every shard, handed to the scheduler's workers
+struct ShardStep {
+    const b2WorldId* worlds;
+    float timeStep;
+    int subStepCount;
+};
+
+static void StepShards(int startIndex, int endIndex, uint32_t /*workerIndex*/, void* context) {
+    const ShardStep* step = (const ShardStep*)context;
+    for (int i = startIndex; i < endIndex; i++) {
+        b2World_Step(step->worlds[i], step->timeStep, step->subStepCount);
+    }
+}
+
+ShardedWorld::ShardedWorld(int shardCount, float width, const b2WorldDef& worldDef, TaskScheduler* scheduler)
+    : scheduler(scheduler)
+{
+    // Narrower strips would put bodies within reach of two borders at once
+    int maxShards = std::max(1, (int)(width / (2.0f * GHOST_MARGIN)));
+    shardCount = std::clamp(shardCount, 1, maxShards);
+    shardWidth = width / shardCount;
+    
+    // The workers share out whole worlds, so each world runs its own tasks inline
+    b2WorldDef shardDef = worldDef;
+    shardDef.workerCount = 1;
+    shardDef.enqueueTask = nullptr;
+    shardDef.finishTask = nullptr;
+    shardDef.userTaskContext = nullptr;
+    
+    b2BodyDef ghostWallDef = b2DefaultBodyDef();
+    ghostWallDef.type = b2_staticBody;
+    
+    worlds.reserve(shardCount);
+    ghostWalls.reserve(shardCount);
+    for (int i = 0; i < shardCount; i++) {
+        worlds.push_back(b2CreateWorld(&shardDef));
+        ghostWalls.push_back(b2CreateBody(worlds.back(), &ghostWallDef));
+    }
+}
+
+ShardedWorld::~ShardedWorld() {
+    for (b2WorldId worldId : worlds) {
+        b2DestroyWorld(worldId);
+    }
+}
+
+int ShardedWorld::ShardAt(float x) const {
+    // Bodies pushed past the outer walls stay with the outermost shards
+    int shard = (int)floorf(x / shardWidth);
+    return std::clamp(shard, 0, Count() - 1);
+}
+
+int ShardedWorld::NeighbourNear(float x, int shard) const {
+    if (shard > 0 && x - ShardLeft(shard) < GHOST_MARGIN) return shard - 1;
+    if (shard + 1 < Count() && ShardLeft(shard + 1) - x < GHOST_MARGIN) return shard + 1;
+    return -1;
+}
+
+void ShardedWorld::Step(float timeStep, int subStepCount) {
+    ShardStep step = { worlds.data(), timeStep, subStepCount };
+    
+    // Shards are dealt out in ranges, one per worker, and a worker that runs
+    // out steals from the others; the calling thread takes part in the work
+    if (scheduler) {
+        scheduler->Wait(scheduler->Submit(&StepShards, Count(), 1, &step));
+    } else {
+        StepShards(0, Count(), 0, &step);
+    }
+}
+
+void ShardedWorld::Populate(const EntityStore& entities) {
+    // Bodies are never added after the world is built, only recreated
+    ballSlots.assign(entities.balls.Count(), -1);
+    brickSlots.assign(entities.bricks.Count(), -1);
+    
+    for (int i = 0; i < entities.balls.Count(); i++) {
+        float x = b2Body_GetPosition(entities.balls.GetBodyId(i)).x * Game::PIXELS_PER_METER;
+        int neighbour = NeighbourNear(x, ShardAt(x));
+        if (neighbour >= 0) AddGhost(entities, EntityRef{ EntityKind::Ball, i }, neighbour);
+    }
+    
+    for (int i = 0; i < entities.bricks.Count(); i++) {
+        if (entities.bricks.IsCulled(i)) continue;
+        
+        float x = entities.bricks.GetTransform(i).p.x * Game::PIXELS_PER_METER;
+        int neighbour = NeighbourNear(x, ShardAt(x));
+        if (neighbour < 0) continue;
+        
+        if (entities.bricks.IsAttached(i)) {
+            wallGhosts[i] = entities.bricks.CreateWallGhost(i, ghostWalls[neighbour]);
+        } else {
+            AddGhost(entities, EntityRef{ EntityKind::Brick, i }, neighbour);
+        }
+    }
+}
+
+void ShardedWorld::BrickBroken(int index) {
+    auto ghost = wallGhosts.find(index);
+    if (ghost == wallGhosts.end()) return;
+    
+    b2DestroyShape(ghost->second, false);  // Static body, no mass to update
+    wallGhosts.erase(ghost);
+}
+
+void ShardedWorld::Exchange(EntityStore& entities) {
+    // Gather the moves of every world first, a world's events must not be
+    // read while its bodies are being destroyed
+    moved.clear();
+    for (int shard = 0; shard < Count(); shard++) {
+        b2BodyEvents events = b2World_GetBodyEvents(worlds[shard]);
+        for (int i = 0; i < events.moveCount; i++) {
+            const b2BodyMoveEvent& move = events.moveEvents[i];
+            EntityRef ref = DecodeEntity(move.userData);
+            if (ref.kind != EntityKind::Ball && ref.kind != EntityKind::Brick) continue;
+            
+            float x = move.transform.p.x * Game::PIXELS_PER_METER;
+            moved.push_back(Moved{ ref, x, shard, ShardAt(x) });
+        }
+    }
+    
+    // Bodies that crossed a border continue in their new world, bodies that
+    // came near one get a ghost on the other side
+    for (const Moved& body : moved) {
+        if (body.to != body.from) {
+            if (body.ref.kind == EntityKind::Ball) {
+                entities.balls.MoveToWorld(body.ref.index, worlds[body.to]);
+            } else {
+                entities.bricks.MoveToWorld(body.ref.index, worlds[body.to]);
+            }
+            migrations++;
+        }
+        
+        int neighbour = NeighbourNear(body.x, body.to);
+        if (neighbour >= 0 && GhostSlot(body.ref) < 0) {
+            AddGhost(entities, body.ref, neighbour);
+        }
+    }
+    
+    // Ghosts follow their owner until it leaves the margin, crosses over to
+    // their side or is culled; sleeping owners send no moves but are followed too
+    int slot = 0;
+    while (slot < (int)ghosts.size()) {
+        Ghost ghost = ghosts[slot];
+        b2BodyId ownerId = OwnerBody(entities, ghost.owner);
+        
+        int target = -1;
+        if (B2_IS_NON_NULL(ownerId)) {
+            float x = b2Body_GetPosition(ownerId).x * Game::PIXELS_PER_METER;
+            target = NeighbourNear(x, ShardAt(x));
+        }
+        
+        // The last ghost takes the removed one's slot, so look at the slot again
+        if (target != ghost.shard) {
+            RemoveGhost(slot);
+            if (target >= 0) AddGhost(entities, ghost.owner, target);
+            continue;
+        }
+        
+        b2Transform transform = b2Body_GetTransform(ownerId);
+        b2Body_SetTransform(ghost.bodyId, transform.p, transform.q);
+        b2Body_SetLinearVelocity(ghost.bodyId, b2Body_GetLinearVelocity(ownerId));
+        b2Body_SetAngularVelocity(ghost.bodyId, b2Body_GetAngularVelocity(ownerId));
+        slot++;
+    }
+}
+
+int& ShardedWorld::GhostSlot(EntityRef ref) {
+    return ref.kind == EntityKind::Ball ? ballSlots[ref.index] : brickSlots[ref.index];
+}
+
+b2BodyId ShardedWorld::OwnerBody(const EntityStore& entities, EntityRef ref) const {
+    // Culled bricks have no body, their ghost goes with them
+    return ref.kind == EntityKind::Ball ? entities.balls.GetBodyId(ref.index)
+                                        : entities.bricks.GetBodyId(ref.index);
+}
+
+void ShardedWorld::AddGhost(const EntityStore& entities, EntityRef ref, int shard) {
+    b2BodyId bodyId = ref.kind == EntityKind::Ball
+        ? entities.balls.CreateGhost(ref.index, worlds[shard])
+        : entities.bricks.CreateGhost(ref.index, worlds[shard]);
+    
+    GhostSlot(ref) = (int)ghosts.size();
+    ghosts.push_back(Ghost{ ref, shard, bodyId });
+}
+
+void ShardedWorld::RemoveGhost(int slot) {
+    b2DestroyBody(ghosts[slot].bodyId);
+    GhostSlot(ghosts[slot].owner) = -1;
+    
+    // Swap the last ghost in so the array stays dense
+    if (slot + 1 < (int)ghosts.size()) {
+        ghosts[slot] = ghosts.back();
+        GhostSlot(ghosts[slot].owner) = slot;
+    }
+    ghosts.pop_back();
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <box2d/box2d.h>
+#include <unordered_map>
+#include "entity_store.h"
+#include "memory.h"
+
+class TaskScheduler;
+
+// The play area split into vertical strips of equal width, each simulated by
+// a Box2D world of its own so the strips step in parallel
+// A body belongs to the strip holding its centre and is recreated in the
+// next world when it crosses a border. Bodies near a border are mirrored
+// into the neighbouring world as ghosts: kinematic copies of moving bodies
+// and static copies of attached bricks. Ghosts push the neighbour's bodies
+// but are not pushed back, so contacts across a border are one-way
+class ShardedWorld {
+public:
+    // width is the play area's in pixels; the shard count is reduced until
+    // every strip is at least two ghost margins wide
+    // scheduler shares the shards between its workers, nullptr steps them in turn
+    ShardedWorld(int shardCount, float width, const b2WorldDef& worldDef, TaskScheduler* scheduler);
+    ~ShardedWorld();
+
+    ShardedWorld(const ShardedWorld&) = delete;
+    ShardedWorld& operator=(const ShardedWorld&) = delete;
+
+    int Count() const { return (int)worlds.size(); }
+    b2WorldId World(int shard) const { return worlds[shard]; }
+
+    // Shard owning the point x pixels from the left of the play area
+    int ShardAt(float x) const;
+    b2WorldId WorldAt(float x) const { return worlds[ShardAt(x)]; }
+
+    // Left edge of a shard in pixels, Count() gives the play area's right edge
+    float ShardLeft(int shard) const { return shard * shardWidth; }
+
+    // Step every world by timeStep, one world per worker at a time
+    void Step(float timeStep, int subStepCount);
+
+    // Ghost every body near a border, once the world is built
+    void Populate(const EntityStore& entities);
+
+    // An attached brick broke off its wall, so its static ghost goes away
+    // The brick is ghosted again like any moving body
+    void BrickBroken(int index);
+
+    // Move bodies that crossed a border during the step into their new world
+    // and bring the ghosts up to date, once the step's events were handled
+    void Exchange(EntityStore& entities);
+
+    int GhostCount() const { return (int)ghosts.size() + (int)wallGhosts.size(); }
+    int MigrationCount() const { return migrations; }  // Since the world was built
+
+    // Distance from a border within which a body's centre gets a ghost, in
+    // pixels: a ball diameter plus what a fast body covers in a few steps
+    static constexpr float GHOST_MARGIN = 50.0f;
+
+private:
+    // Kinematic copy of a ball or a loose brick in a neighbouring world
+    struct Ghost {
+        EntityRef owner;
+        int shard;
+        b2BodyId bodyId;
+    };
+
+    // A body that moved during the step, gathered before any world changes
+    struct Moved {
+        EntityRef ref;
+        float x;   // Pixels
+        int from;  // Shard whose world simulated the step
+        int to;    // Shard now holding its centre
+    };
+
+    float shardWidth;
+    TaskScheduler* scheduler;
+    TrackedVector<b2WorldId, MemorySystem::Entities> worlds;
+    TrackedVector<b2BodyId, MemorySystem::Entities> ghostWalls;  // Per shard, carries its brick ghosts
+    TrackedVector<Ghost, MemorySystem::Entities> ghosts;
+    TrackedVector<int, MemorySystem::Entities> ballSlots;   // Index into ghosts per ball, -1 for none
+    TrackedVector<int, MemorySystem::Entities> brickSlots;  // Index into ghosts per brick, -1 for none
+    std::unordered_map<int, b2ShapeId> wallGhosts;          // Static ghosts of attached bricks by brick
+    TrackedVector<Moved, MemorySystem::Entities> moved;
+    int migrations = 0;
+
+    // Neighbour of shard whose border lies within the ghost margin of x, or -1
+    int NeighbourNear(float x, int shard) const;
+    int& GhostSlot(EntityRef ref);
+    void AddGhost(const EntityStore& entities, EntityRef ref, int shard);
+    void RemoveGhost(int slot);
+    b2BodyId OwnerBody(const EntityStore& entities, EntityRef ref) const;
+};
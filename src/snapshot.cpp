@@ -0,0 +1,194 @@
+#include "snapshot.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_WIN32)
+// Keep windows.h from declaring GDI and user functions that clash with raylib
+#define WIN32_LEAN_AND_MEAN
+#define NOGDI
+#define NOUSER
+#define NOMINMAX
+#include <windows.h>
+#define RAYCODE_HAS_MMAP 1
+#elif defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define RAYCODE_HAS_MMAP 1
+#endif
+
+static uint64_t AlignUp(uint64_t value) {
+    return (value + 7) & ~(uint64_t)7;
+}
+
+void LayoutSnapshot(SnapshotHeader& header) {
+    uint64_t offset = AlignUp(sizeof(SnapshotHeader));
+    header.ballOffset = offset;
+    offset = AlignUp(offset + (uint64_t)header.ballCount * sizeof(BallState));
+    header.brickOffset = offset;
+    offset = AlignUp(offset + (uint64_t)header.brickCount * sizeof(BrickState));
+    header.wallOffset = offset;
+    offset = AlignUp(offset + (uint64_t)header.wallCount * sizeof(WallState));
+    header.lightOffset = offset;
+    offset = AlignUp(offset + (uint64_t)header.lightCount * sizeof(LightState));
+    header.debrisOffset = offset;
+    offset = AlignUp(offset + (uint64_t)header.debrisCount * sizeof(DebrisState));
+    header.fileSize = offset;
+}
+
+bool ViewSnapshot(const void* data, size_t size, WorldSnapshot& snapshot, std::string& error) {
+    const SnapshotHeader* header = (const SnapshotHeader*)data;
+    if (!data || size < sizeof(SnapshotHeader)
+        || memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+        error = "not a world snapshot";
+        return false;
+    }
+    if (header->version != SNAPSHOT_VERSION) {
+        error = "unsupported snapshot version " + std::to_string(header->version);
+        return false;
+    }
+
+    // Recompute the layout rather than trusting the offsets, then every array is in bounds
+    SnapshotHeader expected = *header;
+    LayoutSnapshot(expected);
+    if (expected.ballOffset != header->ballOffset || expected.brickOffset != header->brickOffset
+        || expected.wallOffset != header->wallOffset || expected.lightOffset != header->lightOffset
+        || expected.debrisOffset != header->debrisOffset
+        || expected.fileSize != header->fileSize || header->fileSize > size) {
+        error = "snapshot is truncated or corrupt";
+        return false;
+    }
+
+    const unsigned char* bytes = (const unsigned char*)data;
+    snapshot.header = header;
+    snapshot.balls = (const BallState*)(bytes + header->ballOffset);
+    snapshot.bricks = (const BrickState*)(bytes + header->brickOffset);
+    snapshot.walls = (const WallState*)(bytes + header->wallOffset);
+    snapshot.lights = (const LightState*)(bytes + header->lightOffset);
+    snapshot.debris = (const DebrisState*)(bytes + header->debrisOffset);
+
+    // Attached bricks must point at a wall that exists
+    for (uint32_t i = 0; i < header->brickCount; i++) {
+        int32_t wall = snapshot.bricks[i].wall;
+        if (wall < -1 || wall >= (int32_t)header->wallCount) {
+            error = "snapshot brick refers to a missing wall";
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < header->wallCount; i++) {
+        const WallState& wall = snapshot.walls[i];
+        if (wall.firstBrick < 0 || wall.brickCount < 0
+            || (int64_t)wall.firstBrick + wall.brickCount > (int64_t)header->brickCount) {
+            error = "snapshot wall refers to missing bricks";
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < header->debrisCount; i++) {
+        int32_t brick = snapshot.debris[i].brickIndex;
+        if (brick < 0 || brick >= (int32_t)header->brickCount) {
+            error = "snapshot debris refers to a missing brick";
+            return false;
+        }
+    }
+    return true;
+}
+
+MappedFile::~MappedFile() {
+#if defined(_WIN32)
+    if (mapped) {
+        UnmapViewOfFile(data);
+        return;
+    }
+#elif defined(RAYCODE_HAS_MMAP)
+    if (mapped) {
+        munmap((void*)data, size);
+        return;
+    }
+#endif
+    free((void*)data);
+}
+
+bool MappedFile::Open(const char* path, std::string& error) {
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        error = std::string("cannot open ") + path;
+        return false;
+    }
+
+    LARGE_INTEGER length;
+    if (!GetFileSizeEx(file, &length) || length.QuadPart == 0) {
+        CloseHandle(file);
+        error = std::string("cannot read ") + path;
+        return false;
+    }
+
+    // The view keeps the mapping alive, so both handles can be closed right away
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    const void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (mapping) CloseHandle(mapping);
+    if (!view) {
+        error = std::string("cannot map ") + path;
+        return false;
+    }
+
+    data = view;
+    size = (size_t)length.QuadPart;
+    mapped = true;
+    return true;
+#elif defined(RAYCODE_HAS_MMAP)
+    int descriptor = open(path, O_RDONLY);
+    if (descriptor < 0) {
+        error = std::string("cannot open ") + path;
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(descriptor, &info) != 0 || info.st_size == 0) {
+        close(descriptor);
+        error = std::string("cannot read ") + path;
+        return false;
+    }
+
+    // Pages are faulted in as the restore walks the arrays, nothing is copied up front
+    void* view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    close(descriptor);
+    if (view == MAP_FAILED) {
+        error = std::string("cannot map ") + path;
+        return false;
+    }
+
+    data = view;
+    size = (size_t)info.st_size;
+    mapped = true;
+    return true;
+#else
+    // No mmap on this platform, read the file in one go instead
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        error = std::string("cannot open ") + path;
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    void* buffer = length > 0 ? malloc((size_t)length) : nullptr;
+    bool ok = buffer && fread(buffer, 1, (size_t)length, file) == (size_t)length;
+    fclose(file);
+    if (!ok) {
+        free(buffer);
+        error = std::string("cannot read ") + path;
+        return false;
+    }
+
+    data = buffer;
+    size = (size_t)length;
+    return true;
+#endif
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <raylib.h>
+#include <box2d/box2d.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+// Flat binary snapshot of a running world
+// The file is a header followed by one array per entity kind, each at an
+// 8-byte aligned offset recorded in the header. Every record is plain data
+// in native byte order, so a mapped file is used in place without parsing
+
+struct SnapshotHeader {
+    char magic[4];            // "RCSS"
+    uint32_t version;
+    uint32_t ballCount;
+    uint32_t brickCount;
+    uint32_t wallCount;
+    uint32_t lightCount;
+    uint32_t debrisCount;     // Broken bricks still tracked by the DebrisManager
+    uint32_t frozenDebris;
+    uint32_t culledDebris;
+    uint32_t reserved;
+    uint64_t ballOffset;      // Byte offsets of the arrays from the start of the file
+    uint64_t brickOffset;
+    uint64_t wallOffset;
+    uint64_t lightOffset;
+    uint64_t debrisOffset;
+    uint64_t fileSize;
+    uint64_t stepCount;
+    uint64_t randomState;     // State of the game's random stream
+    float worldWidth;         // Pixels
+    float worldHeight;
+    float accumulator;        // Unsimulated time carried into the next update
+    uint32_t padding;
+};
+
+// Ball body and looks, in meters like Box2D
+struct BallState {
+    b2Vec2 position;
+    b2Rot rotation;
+    b2Vec2 linearVelocity;
+    float angularVelocity;
+    float restitution;
+    float radius;             // Pixels
+    Color color;
+    uint8_t flags;            // BallStore flags
+    uint8_t awake;
+    uint8_t padding[2];
+};
+
+// Brick transform, motion and state, in meters like Box2D
+// Attached bricks name the wall whose body carries their shape
+struct BrickState {
+    b2Vec2 position;
+    b2Rot rotation;
+    b2Vec2 linearVelocity;
+    float angularVelocity;
+    int32_t wall;             // Index into the wall array, -1 for a brick with its own body
+    Color color;
+    uint8_t flags;            // BrickStore flags
+    uint8_t awake;
+    uint8_t padding[2];
+};
+
+// Static wall body, its bricks are the contiguous range starting at firstBrick
+struct WallState {
+    b2Vec2 position;
+    int32_t firstBrick;
+    int32_t brickCount;
+};
+
+struct LightState {
+    int32_t type;             // LightType
+    Vector2 position;
+    Vector2 direction;
+    Vector3 attenuation;
+};
+
+// Debris still moving or settling, in the DebrisManager's oldest first order
+struct DebrisState {
+    int32_t brickIndex;
+    uint32_t padding;
+    uint64_t restingSince;    // Step the body fell asleep, 0 while it moves
+};
+
+static_assert(std::is_trivially_copyable<SnapshotHeader>::value, "snapshot records must be plain data");
+static_assert(std::is_trivially_copyable<BallState>::value, "snapshot records must be plain data");
+static_assert(std::is_trivially_copyable<BrickState>::value, "snapshot records must be plain data");
+static_assert(std::is_trivially_copyable<WallState>::value, "snapshot records must be plain data");
+static_assert(std::is_trivially_copyable<LightState>::value, "snapshot records must be plain data");
+static_assert(std::is_trivially_copyable<DebrisState>::value, "snapshot records must be plain data");
+
+static constexpr char SNAPSHOT_MAGIC[4] = { 'R', 'C', 'S', 'S' };
+static constexpr uint32_t SNAPSHOT_VERSION = 1;
+
+// Read-only view of a snapshot held in memory or in a mapped file
+struct WorldSnapshot {
+    const SnapshotHeader* header = nullptr;
+    const BallState* balls = nullptr;
+    const BrickState* bricks = nullptr;
+    const WallState* walls = nullptr;
+    const LightState* lights = nullptr;
+    const DebrisState* debris = nullptr;
+};
+
+// Byte offset of every array for the given counts, and the total file size
+void LayoutSnapshot(SnapshotHeader& header);
+
+// Point a view into snapshot bytes after checking that every array fits
+// Returns false and describes the problem in error if the data is not a snapshot
+bool ViewSnapshot(const void* data, size_t size, WorldSnapshot& snapshot, std::string& error);
+
+// A whole file mapped read-only into memory, or read into a buffer where
+// mapping is not available
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool Open(const char* path, std::string& error);
+    const void* Data() const { return data; }
+    size_t Size() const { return size; }
+
+private:
+    const void* data = nullptr;
+    size_t size = 0;
+    bool mapped = false;
+};
@@ -0,0 +1,123 @@
+// spectator.cpp : Minimal headless receiver of the spectator stream
+//
+// Listens for a game started with --stream PORT, rebuilds every snapshot,
+// acknowledges it so the game can send deltas against it, and prints what
+// it received as JSON when it stops
+#include "spectator_stream.h"
+#include "brick.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using SpectatorClock = std::chrono::steady_clock;
+
+static void PrintSpectatorUsage() {
+    printf("usage: raycode_spectator [--port N] [--seconds S] [--snapshots N]\n");
+}
+
+int main(int argc, char** argv) {
+    int port = 7777;
+    double seconds = 10.0;
+    int maxSnapshots = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (strcmp(arg, "--port") == 0 && hasValue) {
+            port = atoi(argv[++i]);
+        } else if (strcmp(arg, "--seconds") == 0 && hasValue) {
+            seconds = atof(argv[++i]);
+        } else if (strcmp(arg, "--snapshots") == 0 && hasValue) {
+            maxSnapshots = atoi(argv[++i]);
+        } else {
+            PrintSpectatorUsage();
+            return 1;
+        }
+    }
+    if (port <= 0 || port > 65535 || seconds <= 0.0 || maxSnapshots < 0) {
+        PrintSpectatorUsage();
+        return 1;
+    }
+
+    LocalSocket socket;
+    std::string error;
+    if (!socket.Open(port, error)) {
+        fprintf(stderr, "spectator: %s\n", error.c_str());
+        return 1;
+    }
+
+    SpectatorView view;
+    std::vector<uint8_t> buffer(STREAM_MAX_PACKET);
+    int64_t packets = 0;
+    int64_t bytes = 0;
+    int64_t rejected = 0;
+    int snapshots = 0;
+
+    StreamAck ack = {};
+    memcpy(ack.magic, STREAM_MAGIC, sizeof(STREAM_MAGIC));
+    ack.version = STREAM_VERSION;
+    ack.kind = StreamPacketKind::Ack;
+
+    // Time starts with the first packet, so the receiver may be started first
+    SpectatorClock::time_point start = SpectatorClock::now();
+    SpectatorClock::time_point firstPacket = start;
+    double elapsed = 0.0;
+    while (elapsed < seconds && (maxSnapshots == 0 || snapshots < maxSnapshots)) {
+        socket.Wait(100);
+
+        int size;
+        while ((size = socket.Receive(buffer.data(), buffer.size())) >= 0) {
+            if (packets == 0) firstPacket = SpectatorClock::now();
+            packets++;
+            bytes += size;
+
+            uint32_t completed = 0;
+            if (!view.Receive(buffer.data(), (size_t)size, completed)) {
+                rejected++;
+                continue;
+            }
+            if (completed != 0) {
+                snapshots++;
+                ack.session = view.Session();
+                ack.sequence = completed;
+                socket.Send(&ack, sizeof(ack));
+            }
+        }
+
+        SpectatorClock::time_point now = SpectatorClock::now();
+        elapsed = std::chrono::duration<double>(now - (packets > 0 ? firstPacket : start)).count();
+    }
+
+    // Bricks still on their walls are the static part of the world
+    int ballCount = view.BallCount();
+    int brickCount = view.BrickCount();
+    const StreamEntity* entities = view.Entities();
+    int attached = 0;
+    for (int i = 0; i < brickCount; i++) {
+        if (entities[ballCount + i].flags & BrickStore::FLAG_ATTACHED) attached++;
+    }
+
+    printf("{\n");
+    printf("  \"mode\": \"spectator\",\n");
+    printf("  \"port\": %d,\n", port);
+    printf("  \"seconds\": %.3f,\n", elapsed);
+    printf("  \"packets\": %lld,\n", (long long)packets);
+    printf("  \"rejectedPackets\": %lld,\n", (long long)rejected);
+    printf("  \"bytes\": %lld,\n", (long long)bytes);
+    printf("  \"kbPerSecond\": %.3f,\n", elapsed > 0.0 ? bytes / 1024.0 / elapsed : 0.0);
+    printf("  \"snapshots\": %d,\n", snapshots);
+    printf("  \"bytesPerSnapshot\": %.1f,\n", snapshots > 0 ? (double)bytes / snapshots : 0.0);
+    printf("  \"entries\": %lld,\n", (long long)view.EntriesDecoded());
+    printf("  \"missingBaselines\": %d,\n", view.MissingBaselines());
+    printf("  \"incompleteSnapshots\": %d,\n", view.IncompleteSnapshots());
+    printf("  \"latest\": {\"sequence\": %u, \"step\": %llu, \"balls\": %d, \"bricks\": %d, \"attachedBricks\": %d, "
+           "\"hash\": \"%016llx\"}\n",
+        view.Sequence(), (unsigned long long)view.Step(), ballCount, brickCount, attached,
+        (unsigned long long)HashStreamEntities(entities, ballCount + brickCount));
+    printf("}\n");
+    return 0;
+}
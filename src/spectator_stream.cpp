@@ -0,0 +1,487 @@
+#include "spectator_stream.h"
+#include "entity_store.h"
+#include "game.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+#if defined(_WIN32)
+// Keep windows.h from declaring GDI and user functions that clash with raylib
+#define WIN32_LEAN_AND_MEAN
+#define NOGDI
+#define NOUSER
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#define RAYCODE_HAS_SOCKETS 1
+
+typedef SOCKET NativeSocket;
+typedef int NativeLength;
+static const NativeSocket NO_SOCKET = INVALID_SOCKET;
+
+// Winsock is started once for the process and left running
+static bool StartSockets() {
+    static const bool started = [] {
+        WSADATA data;
+        return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+    }();
+    return started;
+}
+
+static void CloseSocket(NativeSocket socket) { closesocket(socket); }
+
+static void SetNonBlocking(NativeSocket socket) {
+    u_long enabled = 1;
+    ioctlsocket(socket, FIONBIO, &enabled);
+}
+
+static int PollSocket(NativeSocket socket, int timeoutMs) {
+    WSAPOLLFD request = { socket, POLLRDNORM, 0 };
+    return WSAPoll(&request, 1, timeoutMs);
+}
+#elif defined(__unix__) || defined(__APPLE__)
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#define RAYCODE_HAS_SOCKETS 1
+
+typedef int NativeSocket;
+typedef socklen_t NativeLength;
+static const NativeSocket NO_SOCKET = -1;
+
+static bool StartSockets() { return true; }
+
+static void CloseSocket(NativeSocket socket) { close(socket); }
+
+static void SetNonBlocking(NativeSocket socket) {
+    fcntl(socket, F_SETFL, fcntl(socket, F_GETFL, 0) | O_NONBLOCK);
+}
+
+static int PollSocket(NativeSocket socket, int timeoutMs) {
+    pollfd request = { socket, POLLIN, 0 };
+    return poll(&request, 1, timeoutMs);
+}
+#endif
+
+// Longest entry: gap, mask, three deltas and the flags
+static constexpr size_t MAX_ENTRY_BYTES = 5 + 1 + 5 + 5 + 3 + 1;
+
+// Fields of an entry, in the order they follow its mask
+static constexpr uint8_t FIELD_X = 1 << 0;
+static constexpr uint8_t FIELD_Y = 1 << 1;
+static constexpr uint8_t FIELD_ANGLE = 1 << 2;
+static constexpr uint8_t FIELD_FLAGS = 1 << 3;
+
+static void PutVarint(TrackedVector<uint8_t, MemorySystem::Entities>& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((uint8_t)value);
+}
+
+static bool GetVarint(const uint8_t* data, size_t size, size_t& offset, uint32_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 35 && offset < size; shift += 7) {
+        uint8_t byte = data[offset++];
+        value |= (uint32_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) return true;
+    }
+    return false;
+}
+
+// Small deltas of either sign become small unsigned values
+static uint32_t ZigZag(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static int32_t UnZigZag(uint32_t value) {
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+static StreamEntity Quantize(const b2Transform& transform, uint8_t flags) {
+    const float scale = Game::PIXELS_PER_METER * STREAM_POSITION_SCALE;
+    float turns = b2Rot_GetAngle(transform.q) / (2.0f * B2_PI);
+
+    StreamEntity entity;
+    entity.x = (int32_t)lrintf(transform.p.x * scale);
+    entity.y = (int32_t)lrintf(transform.p.y * scale);
+    entity.angle = (uint16_t)(int32_t)lrintf(turns * 65536.0f);
+    entity.flags = flags;
+    return entity;
+}
+
+static bool IsStreamPacket(const void* data, size_t size, size_t expected, StreamPacketKind kind) {
+    if (size < expected) return false;
+    StreamAck prefix;  // Both packet kinds start alike
+    memcpy(&prefix, data, sizeof(prefix));
+    return memcmp(prefix.magic, STREAM_MAGIC, sizeof(STREAM_MAGIC)) == 0
+        && prefix.version == STREAM_VERSION && prefix.kind == kind;
+}
+
+uint64_t HashStreamEntities(const StreamEntity* entities, int count) {
+    uint64_t hash = 14695981039346656037ull;
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(entities);
+    for (size_t i = 0; i < (size_t)count * sizeof(StreamEntity); i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+LocalSocket::~LocalSocket() {
+#ifdef RAYCODE_HAS_SOCKETS
+    if (handle >= 0) CloseSocket((NativeSocket)handle);
+#endif
+}
+
+bool LocalSocket::Open(int port, std::string& error) {
+#ifdef RAYCODE_HAS_SOCKETS
+    if (!StartSockets()) {
+        error = "cannot start Winsock";
+        return false;
+    }
+    NativeSocket created = socket(AF_INET, SOCK_DGRAM, 0);
+    if (created == NO_SOCKET) {
+        error = "cannot create a UDP socket";
+        return false;
+    }
+    handle = (intptr_t)created;
+    SetNonBlocking(created);
+
+    // Room for the fragments of a few large snapshots in flight
+    int bufferBytes = 4 * 1024 * 1024;
+    setsockopt(created, SOL_SOCKET, SO_RCVBUF, (const char*)&bufferBytes, sizeof(bufferBytes));
+    setsockopt(created, SOL_SOCKET, SO_SNDBUF, (const char*)&bufferBytes, sizeof(bufferBytes));
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons((uint16_t)port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(created, (const sockaddr*)&address, sizeof(address)) != 0) {
+        error = "cannot bind to 127.0.0.1:" + std::to_string(port);
+        return false;
+    }
+    return true;
+#else
+    (void)port;
+    error = "spectator streams need sockets, which this platform lacks";
+    return false;
+#endif
+}
+
+bool LocalSocket::Send(const void* data, size_t size, int port) {
+#ifdef RAYCODE_HAS_SOCKETS
+    sockaddr_in address = {};
+    if (port == 0) {
+        if (!hasSender) return false;
+        memcpy(&address, lastSender, sizeof(address));
+    } else {
+        address.sin_family = AF_INET;
+        address.sin_port = htons((uint16_t)port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    }
+    int sent = (int)sendto((NativeSocket)handle, (const char*)data, (NativeLength)size, 0,
+                           (const sockaddr*)&address, sizeof(address));
+    return sent == (int)size;
+#else
+    (void)data; (void)size; (void)port;
+    return false;
+#endif
+}
+
+int LocalSocket::Receive(void* data, size_t capacity) {
+#ifdef RAYCODE_HAS_SOCKETS
+    sockaddr_in address = {};
+    NativeLength length = sizeof(address);
+    int size = (int)recvfrom((NativeSocket)handle, (char*)data, (NativeLength)capacity, 0,
+                             (sockaddr*)&address, &length);
+    if (size < 0) return -1;
+
+    static_assert(sizeof(lastSender) >= sizeof(sockaddr_in));
+    memcpy(lastSender, &address, sizeof(address));
+    hasSender = true;
+    return size;
+#else
+    (void)data; (void)capacity;
+    return -1;
+#endif
+}
+
+bool LocalSocket::Wait(int timeoutMs) {
+#ifdef RAYCODE_HAS_SOCKETS
+    return PollSocket((NativeSocket)handle, timeoutMs) > 0;
+#else
+    (void)timeoutMs;
+    return false;
+#endif
+}
+
+bool SpectatorStream::Open(int streamPort, std::string& error) {
+    port = streamPort;
+    session = std::random_device{}();
+    return socket.Open(0, error);
+}
+
+void SpectatorStream::Publish(const EntityStore& entities, uint64_t step) {
+    ReadAcks();
+    Capture(entities, step);
+
+    // The acknowledged snapshot is a usable baseline while both ends still hold it
+    uint32_t baseline = 0;
+    if (acked != 0 && sequence - acked < (uint32_t)STREAM_HISTORY
+        && history[acked % STREAM_HISTORY].sequence == acked) {
+        baseline = acked;
+    }
+
+    // Without one nobody may be listening, so full snapshots are spaced out
+    if (baseline == 0) {
+        if (lastKeyframe != 0 && sequence - lastKeyframe < (uint32_t)KEYFRAME_STEPS) return;
+        lastKeyframe = sequence;
+        keyframes++;
+    }
+
+    Send(baseline, step, entities.balls.Count(), entities.bricks.Count());
+    sentSequence = sequence;
+    snapshots++;
+
+    // What was sent may become the baseline of a later snapshot
+    Baseline& sent = history[sequence % STREAM_HISTORY];
+    sent.sequence = sequence;
+    sent.entities.assign(current.begin(), current.end());
+}
+
+uint64_t SpectatorStream::SentHash() const {
+    if (sentSequence == 0) return 0;
+    const Baseline& sent = history[sentSequence % STREAM_HISTORY];
+    return HashStreamEntities(sent.entities.data(), (int)sent.entities.size());
+}
+
+void SpectatorStream::ReadAcks() {
+    StreamAck ack;
+    int size;
+    while ((size = socket.Receive(&ack, sizeof(ack))) >= 0) {
+        if (!IsStreamPacket(&ack, (size_t)size, sizeof(ack), StreamPacketKind::Ack)) continue;
+        if (ack.session == session && ack.sequence <= sequence) acked = std::max(acked, ack.sequence);
+    }
+}
+
+void SpectatorStream::Capture(const EntityStore& entities, uint64_t step) {
+    sequence++;
+
+    const BallStore& balls = entities.balls;
+    const BrickStore& bricks = entities.bricks;
+    int ballCount = balls.Count();
+    int brickCount = bricks.Count();
+
+    // Bricks follow the balls, a change in ball count moves every brick
+    if (capturedBalls != ballCount) {
+        capturedBalls = 0;
+        capturedBricks = 0;
+    }
+    size_t total = (size_t)ballCount + (size_t)brickCount;
+    current.resize(total);
+    changedIn.resize(total, 0);
+
+    // Only bodies Box2D reported moving in this step can have changed
+    for (int i = 0; i < ballCount; i++) {
+        bool known = i < capturedBalls;
+        if (known && !balls.MovedIn(i, step)) continue;
+
+        StreamEntity entity = Quantize(balls.GetTransform(i), balls.IsPlayer(i) ? BallStore::FLAG_PLAYER : 0);
+        if (!known || !(entity == current[i])) {
+            current[i] = entity;
+            changedIn[i] = sequence;
+        }
+    }
+
+    // Attached, frozen and culled bricks are static, only their flags can change
+    const uint8_t staticFlags = BrickStore::FLAG_ATTACHED | BrickStore::FLAG_FROZEN | BrickStore::FLAG_CULLED;
+    for (int i = 0; i < brickCount; i++) {
+        size_t e = (size_t)ballCount + i;
+        uint8_t flags = bricks.GetFlags(i);
+        bool known = i < capturedBricks;
+        if (known && flags == current[e].flags && ((flags & staticFlags) != 0 || !bricks.MovedIn(i, step))) continue;
+
+        StreamEntity entity = Quantize(bricks.GetTransform(i), flags);
+        if (!known || !(entity == current[e])) {
+            current[e] = entity;
+            changedIn[e] = sequence;
+        }
+    }
+
+    capturedBalls = ballCount;
+    capturedBricks = brickCount;
+}
+
+void SpectatorStream::Send(uint32_t baseline, uint64_t step, int ballCount, int brickCount) {
+    const Baseline* base = baseline != 0 ? &history[baseline % STREAM_HISTORY] : nullptr;
+    size_t baseCount = base ? base->entities.size() : 0;
+    uint32_t total = (uint32_t)current.size();
+
+    StreamPacketHeader header = {};
+    memcpy(header.magic, STREAM_MAGIC, sizeof(STREAM_MAGIC));
+    header.version = STREAM_VERSION;
+    header.kind = StreamPacketKind::State;
+    header.session = session;
+    header.sequence = sequence;
+    header.baseline = baseline;
+    header.step = step;
+    header.ballCount = (uint32_t)ballCount;
+    header.brickCount = (uint32_t)brickCount;
+
+    // Lay every fragment out in one buffer, the headers are completed once
+    // the fragment count is known
+    packet.clear();
+    fragmentStarts.clear();
+    auto beginFragment = [&](uint32_t first) {
+        fragmentStarts.push_back(packet.size());
+        header.firstEntity = first;
+        packet.resize(packet.size() + sizeof(header));
+        memcpy(&packet[fragmentStarts.back()], &header, sizeof(header));
+    };
+    auto endFragment = [&](uint32_t end) {
+        StreamPacketHeader* written = reinterpret_cast<StreamPacketHeader*>(&packet[fragmentStarts.back()]);
+        written->endEntity = end;
+    };
+
+    const StreamEntity zero;
+    uint32_t next = 0;  // Entity after the previous entry
+    beginFragment(0);
+    for (uint32_t e = 0; e < total; e++) {
+        if (changedIn[e] <= baseline) continue;
+
+        const StreamEntity& from = e < baseCount ? base->entities[e] : zero;
+        const StreamEntity& to = current[e];
+        uint8_t mask = (to.x != from.x ? FIELD_X : 0) | (to.y != from.y ? FIELD_Y : 0)
+            | (to.angle != from.angle ? FIELD_ANGLE : 0) | (to.flags != from.flags ? FIELD_FLAGS : 0);
+        if (mask == 0) continue;
+
+        if (packet.size() - fragmentStarts.back() + MAX_ENTRY_BYTES > (size_t)STREAM_MAX_PACKET) {
+            endFragment(e);
+            beginFragment(e);
+            next = e;
+        }
+
+        PutVarint(packet, e - next);
+        packet.push_back(mask);
+        if (mask & FIELD_X) PutVarint(packet, ZigZag((int32_t)((uint32_t)to.x - (uint32_t)from.x)));
+        if (mask & FIELD_Y) PutVarint(packet, ZigZag((int32_t)((uint32_t)to.y - (uint32_t)from.y)));
+        if (mask & FIELD_ANGLE) PutVarint(packet, ZigZag((int16_t)(uint16_t)(to.angle - from.angle)));
+        if (mask & FIELD_FLAGS) packet.push_back(to.flags);
+        next = e + 1;
+        sentEntries++;
+    }
+    endFragment(total);
+
+    size_t fragmentCount = fragmentStarts.size();
+    for (size_t f = 0; f < fragmentCount; f++) {
+        size_t start = fragmentStarts[f];
+        size_t end = f + 1 < fragmentCount ? fragmentStarts[f + 1] : packet.size();
+        StreamPacketHeader* written = reinterpret_cast<StreamPacketHeader*>(&packet[start]);
+        written->fragment = (uint16_t)f;
+        written->fragmentCount = (uint16_t)fragmentCount;
+
+        // A full socket buffer drops the fragment, the spectator then never
+        // acknowledges the snapshot and later ones fall back to an older baseline
+        if (socket.Send(&packet[start], end - start, port)) {
+            sentBytes += (int64_t)(end - start);
+            sentPackets++;
+        } else {
+            droppedPackets++;
+        }
+    }
+}
+
+bool SpectatorView::Receive(const uint8_t* data, size_t size, uint32_t& completed) {
+    completed = 0;
+    if (!IsStreamPacket(data, size, sizeof(StreamPacketHeader), StreamPacketKind::State)) return false;
+
+    StreamPacketHeader header;
+    memcpy(&header, data, sizeof(header));
+    size_t total = (size_t)header.ballCount + (size_t)header.brickCount;
+    if (header.sequence == 0 || header.fragment >= header.fragmentCount
+        || header.firstEntity > header.endEntity || header.endEntity > total) {
+        return false;
+    }
+
+    // Sequences of a new session start over, nothing held is a baseline for it
+    if (header.session != session) {
+        for (Snapshot& held : history) {
+            held.sequence = 0;
+            held.fragmentsLeft = 0;
+        }
+        session = header.session;
+        latest = 0;
+    }
+
+    Snapshot& snapshot = history[header.sequence % STREAM_HISTORY];
+    if (snapshot.sequence != header.sequence) {
+        if (header.sequence < snapshot.sequence) return false;  // Older than what the slot holds
+
+        // The first fragment to arrive starts the snapshot from its baseline
+        const Snapshot* base = nullptr;
+        if (header.baseline != 0) {
+            base = &history[header.baseline % STREAM_HISTORY];
+            if (base->sequence != header.baseline || base->fragmentsLeft > 0 || base == &snapshot) {
+                missingBaselines++;
+                return false;
+            }
+        }
+
+        if (snapshot.sequence != 0 && snapshot.fragmentsLeft > 0) incomplete++;
+        snapshot.sequence = header.sequence;
+        snapshot.step = header.step;
+        snapshot.ballCount = (int)header.ballCount;
+        snapshot.brickCount = (int)header.brickCount;
+        snapshot.fragmentsLeft = header.fragmentCount;
+        snapshot.fragmentSeen.assign(header.fragmentCount, 0);
+        if (base) {
+            snapshot.entities.assign(base->entities.begin(), base->entities.end());
+        } else {
+            snapshot.entities.clear();
+        }
+        snapshot.entities.resize(total);
+    }
+    if (snapshot.fragmentsLeft == 0 || snapshot.fragmentSeen[header.fragment]) return true;
+
+    size_t offset = sizeof(header);
+    uint32_t next = header.firstEntity;
+    while (offset < size) {
+        uint32_t gap, value;
+        if (!GetVarint(data, size, offset, gap) || offset >= size) return false;
+        uint32_t e = next + gap;
+        if (e < next || e >= header.endEntity) return false;
+
+        uint8_t mask = data[offset++];
+        StreamEntity& entity = snapshot.entities[e];
+        if (mask & FIELD_X) {
+            if (!GetVarint(data, size, offset, value)) return false;
+            entity.x = (int32_t)((uint32_t)entity.x + (uint32_t)UnZigZag(value));
+        }
+        if (mask & FIELD_Y) {
+            if (!GetVarint(data, size, offset, value)) return false;
+            entity.y = (int32_t)((uint32_t)entity.y + (uint32_t)UnZigZag(value));
+        }
+        if (mask & FIELD_ANGLE) {
+            if (!GetVarint(data, size, offset, value)) return false;
+            entity.angle = (uint16_t)(entity.angle + (uint16_t)UnZigZag(value));
+        }
+        if (mask & FIELD_FLAGS) {
+            if (offset >= size) return false;
+            entity.flags = data[offset++];
+        }
+        next = e + 1;
+        entries++;
+    }
+
+    snapshot.fragmentSeen[header.fragment] = 1;
+    if (--snapshot.fragmentsLeft == 0) {
+        completed = snapshot.sequence;
+        latest = std::max(latest, snapshot.sequence);
+    }
+    return true;
+}
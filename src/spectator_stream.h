@@ -0,0 +1,206 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "memory.h"
+
+struct EntityStore;
+
+// Spectator stream: the world state sent once per physics step over UDP on
+// the local machine, for watching or recording a session from another
+// process (see raycode_spectator)
+// Every ball and brick is quantized to a StreamEntity, balls first and then
+// bricks, and only entities that differ from a baseline are sent: the last
+// snapshot the spectator acknowledged, or nothing at all. Each entry is the
+// gap to the previous entry's index, a mask of the fields that changed and
+// their zigzag varint deltas, so resting bodies cost nothing and moving ones
+// a few bytes. A snapshot too large for one datagram is split into
+// fragments covering consecutive entity ranges, each decodable on its own.
+// Packets are plain data in native byte order, like snapshot files
+
+// Quantized transform and state of a ball or brick
+struct StreamEntity {
+    int32_t x = 0;       // Position in 1/STREAM_POSITION_SCALE pixels
+    int32_t y = 0;
+    uint16_t angle = 0;  // Rotation in 1/65536 turns
+    uint8_t flags = 0;   // BallStore or BrickStore flags
+    uint8_t padding = 0;
+
+    bool operator==(const StreamEntity&) const = default;
+};
+
+enum class StreamPacketKind : uint8_t {
+    State,  // Spectator stream fragment, sender to spectator
+    Ack     // Complete snapshot received, spectator to sender
+};
+
+struct StreamPacketHeader {
+    char magic[4];            // "RCSP"
+    uint16_t version;
+    StreamPacketKind kind;
+    uint8_t padding;
+    uint32_t session;         // Random per SpectatorStream, sequences restart with it
+    uint32_t sequence;        // Snapshot number, from 1
+    uint32_t baseline;        // Snapshot the entries are relative to, 0 for none
+    uint16_t fragment;
+    uint16_t fragmentCount;
+    uint64_t step;            // Physics step the snapshot was taken after
+    uint32_t ballCount;       // Balls come first among the entities, then bricks
+    uint32_t brickCount;
+    uint32_t firstEntity;     // Entities covered by this fragment, entries or not
+    uint32_t endEntity;
+};
+
+struct StreamAck {
+    char magic[4];            // "RCSP"
+    uint16_t version;
+    StreamPacketKind kind;
+    uint8_t padding;
+    uint32_t session;         // Of the snapshot
+    uint32_t sequence;        // Snapshot fully received
+};
+
+inline constexpr char STREAM_MAGIC[4] = { 'R', 'C', 'S', 'P' };
+inline constexpr uint16_t STREAM_VERSION = 2;
+inline constexpr float STREAM_POSITION_SCALE = 8.0f;  // Steps per pixel
+inline constexpr int STREAM_HISTORY = 32;             // Snapshots either end keeps as baselines
+inline constexpr int STREAM_MAX_PACKET = 16384;       // Bytes per datagram, well within loopback limits
+
+// FNV-1a hash of quantized entities, for checking that a spectator rebuilt
+// the same snapshot the game sent
+uint64_t HashStreamEntities(const StreamEntity* entities, int count);
+
+// Non-blocking UDP socket on the loopback interface, BSD sockets or Winsock
+class LocalSocket {
+public:
+    LocalSocket() = default;
+    ~LocalSocket();
+
+    LocalSocket(const LocalSocket&) = delete;
+    LocalSocket& operator=(const LocalSocket&) = delete;
+
+    // Bind to port on 127.0.0.1, 0 picks any free port
+    bool Open(int port, std::string& error);
+
+    // Send a datagram to port on 127.0.0.1, or to whoever sent the last
+    // datagram received when port is 0; false if it was dropped
+    bool Send(const void* data, size_t size, int port = 0);
+
+    // Next waiting datagram, or -1 when there is none; data holds up to capacity bytes
+    int Receive(void* data, size_t capacity);
+
+    // Wait up to timeoutMs for a datagram to arrive
+    bool Wait(int timeoutMs);
+
+private:
+    intptr_t handle = -1;         // Descriptor, or SOCKET on Windows
+    uint8_t lastSender[16] = {};  // sockaddr_in of the last datagram received
+    bool hasSender = false;
+};
+
+// Game side of the stream, fed once per physics step
+class SpectatorStream {
+public:
+    // Send to the spectator listening on port of the local machine
+    bool Open(int port, std::string& error);
+
+    // Quantize the entities and send what changed since the acknowledged
+    // baseline. Bodies that did not move in the step and bricks that are
+    // attached, frozen or culled are not even read
+    // Until a spectator acknowledges a snapshot, only a full snapshot goes
+    // out every KEYFRAME_STEPS steps, so nobody listening costs little
+    void Publish(const EntityStore& entities, uint64_t step);
+
+    int64_t SentBytes() const { return sentBytes; }
+    int64_t SentPackets() const { return sentPackets; }
+    int64_t SentEntries() const { return sentEntries; }
+    int64_t DroppedPackets() const { return droppedPackets; }
+    int SnapshotCount() const { return snapshots; }  // Snapshots sent
+    int KeyframeCount() const { return keyframes; }  // Of those, sent without a baseline
+    uint32_t AckedSequence() const { return acked; }
+    
+    // Sequence and hash of the last snapshot sent, compare with the spectator's
+    uint32_t SentSequence() const { return sentSequence; }
+    uint64_t SentHash() const;
+
+    static constexpr int KEYFRAME_STEPS = 30;
+
+private:
+    struct Baseline {
+        uint32_t sequence = 0;
+        TrackedVector<StreamEntity, MemorySystem::Entities> entities;
+    };
+
+    LocalSocket socket;
+    int port = 0;
+    uint32_t session = 0;
+    uint32_t sequence = 0;   // Of the last snapshot captured
+    uint32_t acked = 0;      // Newest snapshot the spectator acknowledged
+    uint32_t lastKeyframe = 0;
+    uint32_t sentSequence = 0;
+    int capturedBalls = 0;   // Quantized at least once, the rest are read in full
+    int capturedBricks = 0;
+
+    // Latest quantized state and the snapshot each entity last changed in
+    TrackedVector<StreamEntity, MemorySystem::Entities> current;
+    TrackedVector<uint32_t, MemorySystem::Entities> changedIn;
+    Baseline history[STREAM_HISTORY];  // Sent snapshots by sequence % STREAM_HISTORY
+    TrackedVector<uint8_t, MemorySystem::Entities> packet;           // Fragments of the snapshot being sent
+    TrackedVector<size_t, MemorySystem::Entities> fragmentStarts;   // Offsets of their headers in packet
+
+    int64_t sentBytes = 0;
+    int64_t sentPackets = 0;
+    int64_t sentEntries = 0;
+    int64_t droppedPackets = 0;
+    int snapshots = 0;
+    int keyframes = 0;
+
+    void ReadAcks();
+    void Capture(const EntityStore& entities, uint64_t step);
+    void Send(uint32_t baseline, uint64_t step, int ballCount, int brickCount);
+};
+
+// Spectator side: rebuilds snapshots from the stream's fragments
+class SpectatorView {
+public:
+    // Decode one datagram, returns false if it is not a stream fragment or
+    // refers to a baseline no longer held
+    // completed is set to the snapshot's sequence once its last fragment
+    // arrived, the caller acknowledges it; 0 otherwise
+    // A fragment of another session, such as a restarted game, drops every
+    // snapshot held and follows the new one
+    bool Receive(const uint8_t* data, size_t size, uint32_t& completed);
+
+    // Session of the snapshots held, for acknowledging them
+    uint32_t Session() const { return session; }
+
+    // The newest complete snapshot
+    uint32_t Sequence() const { return latest; }
+    uint64_t Step() const { return latest ? history[latest % STREAM_HISTORY].step : 0; }
+    int BallCount() const { return latest ? history[latest % STREAM_HISTORY].ballCount : 0; }
+    int BrickCount() const { return latest ? history[latest % STREAM_HISTORY].brickCount : 0; }
+    const StreamEntity* Entities() const { return history[latest % STREAM_HISTORY].entities.data(); }
+
+    int64_t EntriesDecoded() const { return entries; }
+    int MissingBaselines() const { return missingBaselines; }  // Fragments dropped for lack of a baseline
+    int IncompleteSnapshots() const { return incomplete; }     // Overwritten before every fragment arrived
+
+private:
+    struct Snapshot {
+        uint32_t sequence = 0;
+        uint64_t step = 0;
+        int ballCount = 0;
+        int brickCount = 0;
+        int fragmentsLeft = 0;
+        TrackedVector<uint8_t, MemorySystem::Entities> fragmentSeen;
+        TrackedVector<StreamEntity, MemorySystem::Entities> entities;
+    };
+
+    Snapshot history[STREAM_HISTORY];
+    uint32_t session = 0;
+    uint32_t latest = 0;
+    int64_t entries = 0;
+    int missingBaselines = 0;
+    int incomplete = 0;
+};
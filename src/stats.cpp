@@ -0,0 +1,31 @@
+#include "stats.h"
+#include <algorithm>
+#include <cmath>
+
+static double Percentile(const std::vector<double>& sorted, double fraction) {
+    // Nearest-rank percentile over an already sorted series
+    size_t rank = (size_t)std::ceil(fraction * (double)sorted.size());
+    if (rank > 0) rank--;
+    if (rank >= sorted.size()) rank = sorted.size() - 1;
+    return sorted[rank];
+}
+
+SampleSummary Summarize(std::vector<double> samples) {
+    SampleSummary summary;
+    if (samples.empty()) return summary;
+    
+    std::sort(samples.begin(), samples.end());
+    
+    double total = 0.0;
+    for (double sample : samples) {
+        total += sample;
+    }
+    
+    summary.count = (int)samples.size();
+    summary.mean = total / (double)samples.size();
+    summary.p50 = Percentile(samples, 0.50);
+    summary.p99 = Percentile(samples, 0.99);
+    summary.min = samples.front();
+    summary.max = samples.back();
+    return summary;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <vector>
+
+// Summary of a series of timing samples (all values in the samples' unit)
+struct SampleSummary {
+    double mean = 0.0;
+    double p50 = 0.0;
+    double p99 = 0.0;
+    double min = 0.0;
+    double max = 0.0;
+    int count = 0;
+};
+
+// Compute mean and percentiles of the given samples
+// Takes a copy because percentiles need the samples sorted
+SampleSummary Summarize(std::vector<double> samples);
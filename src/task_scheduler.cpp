@@ -0,0 +1,189 @@
+#include "task_scheduler.h"
+#include <algorithm>
+
+// Index of the worker running on this thread; threads not owned by a
+// scheduler (the game thread) act as worker 0
+static thread_local int currentWorkerIndex = 0;
+
+TaskScheduler::TaskScheduler(int workerCount)
+    : workerCount(std::clamp(workerCount, 1, MAX_WORKERS))
+{
+    for (int i = 0; i < this->workerCount; i++) {
+        queues.push_back(std::make_unique<WorkerQueue>());
+    }
+    
+    // Worker 0 is the submitting thread, spawn the rest
+    for (int i = 1; i < this->workerCount; i++) {
+        threads.emplace_back(&TaskScheduler::WorkerMain, this, i);
+    }
+}
+
+TaskScheduler::~TaskScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wakeCondition.notify_all();
+    
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+void TaskScheduler::Attach(b2WorldDef& worldDef) {
+    worldDef.workerCount = workerCount;
+    worldDef.enqueueTask = &TaskScheduler::EnqueueTask;
+    worldDef.finishTask = &TaskScheduler::FinishTask;
+    worldDef.userTaskContext = this;
+}
+
+void* TaskScheduler::Submit(b2TaskCallback* callback, int itemCount, int minRange, void* context) {
+    if (itemCount <= 0) return nullptr;
+    
+    // Split into at most one range per worker, but never below minRange items
+    minRange = std::max(minRange, 1);
+    int rangeCount = std::min(workerCount, (itemCount + minRange - 1) / minRange);
+    
+    // Without helper threads there is nothing to share, run it right here
+    // Single ranges are still queued: Box2D's solver enqueues one task per
+    // worker and relies on them running concurrently
+    if (workerCount == 1) {
+        callback(0, itemCount, (uint32_t)currentWorkerIndex, context);
+        return nullptr;
+    }
+    
+    TaskGroup* group = AcquireGroup();
+    group->callback = callback;
+    group->context = context;
+    group->pending.store(rangeCount, std::memory_order_relaxed);
+    
+    // Deal ranges round-robin over the worker queues so the first pops
+    // need no stealing, starting at a rotating queue to spread the load
+    int rangeSize = itemCount / rangeCount;
+    int remainder = itemCount % rangeCount;
+    int start = 0;
+    int queueIndex = nextQueue.fetch_add(1, std::memory_order_relaxed);
+    
+    for (int i = 0; i < rangeCount; i++) {
+        int end = start + rangeSize + (i < remainder ? 1 : 0);
+        WorkerQueue& queue = *queues[(queueIndex + i) % workerCount];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.jobs.push_back(Job{ group, start, end });
+        }
+        start = end;
+    }
+    
+    queuedJobs.fetch_add(rangeCount, std::memory_order_release);
+    {
+        // Taking the lock orders this wake-up after any worker's predicate check
+        std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    wakeCondition.notify_all();
+    
+    return group;
+}
+
+void TaskScheduler::Wait(void* handle) {
+    TaskGroup* group = static_cast<TaskGroup*>(handle);
+    if (!group) return;
+    
+    // Help with any queued work instead of blocking the caller
+    int worker = currentWorkerIndex;
+    Job job;
+    while (group->pending.load(std::memory_order_acquire) > 0) {
+        if (TryPop(worker, job) || TrySteal(worker, job)) {
+            Run(job, worker);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    
+    ReleaseGroup(group);
+}
+
+void TaskScheduler::WorkerMain(int workerIndex) {
+    currentWorkerIndex = workerIndex;
+    
+    Job job;
+    int idleSpins = 0;
+    
+    while (!stopping.load(std::memory_order_acquire)) {
+        if (TryPop(workerIndex, job) || TrySteal(workerIndex, job)) {
+            Run(job, workerIndex);
+            idleSpins = 0;
+            continue;
+        }
+        
+        // Box2D issues many short tasks per step, so spin briefly before sleeping
+        if (++idleSpins < SPIN_COUNT) {
+            std::this_thread::yield();
+            continue;
+        }
+        
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wakeCondition.wait(lock, [this] {
+            return stopping.load(std::memory_order_acquire) ||
+                   queuedJobs.load(std::memory_order_acquire) > 0;
+        });
+        idleSpins = 0;
+    }
+}
+
+bool TaskScheduler::TryPop(int workerIndex, Job& job) {
+    // Owners take the newest job (LIFO) while thieves take the oldest
+    WorkerQueue& queue = *queues[workerIndex];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.jobs.empty()) return false;
+    
+    job = queue.jobs.back();
+    queue.jobs.pop_back();
+    queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool TaskScheduler::TrySteal(int workerIndex, Job& job) {
+    for (int offset = 1; offset < workerCount; offset++) {
+        WorkerQueue& queue = *queues[(workerIndex + offset) % workerCount];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.jobs.empty()) continue;
+        
+        job = queue.jobs.front();
+        queue.jobs.pop_front();
+        queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+void TaskScheduler::Run(const Job& job, int workerIndex) {
+    job.group->callback(job.start, job.end, (uint32_t)workerIndex, job.group->context);
+    job.group->pending.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+TaskScheduler::TaskGroup* TaskScheduler::AcquireGroup() {
+    std::lock_guard<std::mutex> lock(groupMutex);
+    if (freeGroups.empty()) {
+        groupStorage.push_back(std::make_unique<TaskGroup>());
+        return groupStorage.back().get();
+    }
+    
+    TaskGroup* group = freeGroups.back();
+    freeGroups.pop_back();
+    return group;
+}
+
+void TaskScheduler::ReleaseGroup(TaskGroup* group) {
+    std::lock_guard<std::mutex> lock(groupMutex);
+    freeGroups.push_back(group);
+}
+
+void* TaskScheduler::EnqueueTask(b2TaskCallback* task, int itemCount, int minRange, void* taskContext, void* userContext) {
+    TaskScheduler* scheduler = static_cast<TaskScheduler*>(userContext);
+    return scheduler->Submit(task, itemCount, minRange, taskContext);
+}
+
+void TaskScheduler::FinishTask(void* userTask, void* userContext) {
+    TaskScheduler* scheduler = static_cast<TaskScheduler*>(userContext);
+    scheduler->Wait(userTask);
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <box2d/box2d.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing job system used to run Box2D's parallel tasks
+// Every worker owns a queue; idle workers steal from the others so that
+// uneven task ranges still keep all cores busy. The thread that submits
+// and waits on work (the game thread) takes part as worker 0.
+class TaskScheduler {
+public:
+    // workerCount includes the calling thread, so N - 1 threads are spawned
+    explicit TaskScheduler(int workerCount);
+    ~TaskScheduler();
+
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    int WorkerCount() const { return workerCount; }
+    
+    // Point the world definition's task callbacks at this scheduler
+    void Attach(b2WorldDef& worldDef);
+
+    // Split itemCount items into ranges of at least minRange and queue them
+    // Returns a handle for Wait, or nullptr if the work already ran inline
+    void* Submit(b2TaskCallback* callback, int itemCount, int minRange, void* context);
+    
+    // Block until all ranges of a submitted task are done, helping meanwhile
+    void Wait(void* handle);
+
+    static constexpr int MAX_WORKERS = 64;  // Box2D's B2_MAX_WORKERS
+
+private:
+    struct TaskGroup {
+        b2TaskCallback* callback = nullptr;
+        void* context = nullptr;
+        std::atomic<int> pending{0};
+    };
+    
+    struct Job {
+        TaskGroup* group;
+        int start;
+        int end;
+    };
+    
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    int workerCount;
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::vector<std::thread> threads;
+    
+    // Task groups are recycled so steady-state steps do not allocate
+    std::mutex groupMutex;
+    std::vector<std::unique_ptr<TaskGroup>> groupStorage;
+    std::vector<TaskGroup*> freeGroups;
+    
+    // Sleeping workers wait here until jobs are queued or the scheduler stops
+    std::mutex sleepMutex;
+    std::condition_variable wakeCondition;
+    std::atomic<int> queuedJobs{0};
+    std::atomic<bool> stopping{false};
+    std::atomic<int> nextQueue{0};
+
+    void WorkerMain(int workerIndex);
+    bool TryPop(int workerIndex, Job& job);
+    bool TrySteal(int workerIndex, Job& job);
+    void Run(const Job& job, int workerIndex);
+    TaskGroup* AcquireGroup();
+    void ReleaseGroup(TaskGroup* group);
+
+    static void* EnqueueTask(b2TaskCallback* task, int itemCount, int minRange, void* taskContext, void* userContext);
+    static void FinishTask(void* userTask, void* userContext);
+    
+    static constexpr int SPIN_COUNT = 2000;  // Idle polls before a worker sleeps
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <box2d/box2d.h>
+#include <cstdint>
+#include <vector>
+#include "memory.h"
+
+// Transforms of a set of bodies after the last two physics steps, stored as
+// parallel arrays and used to interpolate rendering between steps
+class TransformHistory {
+public:
+    // Start tracking a body from its spawn transform, returns its slot
+    int Add(const b2Transform& transform) {
+        previous.push_back(transform);
+        current.push_back(transform);
+        lastMovedSteps.push_back(0);
+        return (int)current.size() - 1;
+    }
+    
+    int Count() const { return (int)current.size(); }
+    
+    void Reserve(int count) {
+        previous.reserve(count);
+        current.reserve(count);
+        lastMovedSteps.reserve(count);
+    }
+    
+    // Record the transform Box2D reported after the given physics step
+    // Bodies without a move event kept their transform, so the last
+    // reported one is always the transform before this step
+    void Sync(int index, const b2Transform& transform, uint64_t step) {
+        previous[index] = current[index];
+        current[index] = transform;
+        lastMovedSteps[index] = step;
+    }
+    
+    // Overwrite both transforms, e.g. after teleporting a body
+    void Reset(int index, const b2Transform& transform) {
+        previous[index] = transform;
+        current[index] = transform;
+    }
+    
+    const b2Transform& Current(int index) const { return current[index]; }
+    
+    // Whether Box2D reported the body moving in the given physics step
+    bool MovedIn(int index, uint64_t step) const { return lastMovedSteps[index] == step; }
+    
+    // Transform blended between the last two physics steps
+    // A body that did not move in the latest step is drawn where it rests
+    b2Transform Interpolated(int index, float alpha, uint64_t latestStep) const {
+        if (lastMovedSteps[index] != latestStep) return current[index];
+        
+        b2Transform transform;
+        transform.p = b2Lerp(previous[index].p, current[index].p, alpha);
+        transform.q = b2NLerp(previous[index].q, current[index].q, alpha);
+        return transform;
+    }
+
+private:
+    TrackedVector<b2Transform, MemorySystem::Entities> previous;
+    TrackedVector<b2Transform, MemorySystem::Entities> current;
+    TrackedVector<uint64_t, MemorySystem::Entities> lastMovedSteps;
+};
@@ -1,24 +1,30 @@
 #pragma once
 #include <raylib.h>
-#include <vector>
-#include <memory>
-#include "brick.h"
-#include "IRenderable.h"
+#include <box2d/box2d.h>
 
-class Game;
+class BrickStore;
 
-class Wall : public IRenderable {
+// A straight line of bricks sharing one static body
+// Each brick is a shape on the wall's body until a hit splits it off. The
+// bricks themselves live in the BrickStore, the wall only remembers which
+// contiguous range of it belongs to this wall
+class Wall {
 public:
-    Wall(Game* game, float startX, float startY, int brickCount, bool horizontal, Color color);
-    ~Wall() override = default;
+    Wall(BrickStore& bricks, b2WorldId worldId, float startX, float startY, int brickCount, bool horizontal, Color color);
+    
+    // Recreate the wall's body from a snapshot at position (meters) without
+    // any bricks, the snapshot restores them onto it afterwards
+    Wall(b2WorldId worldId, b2Vec2 position, int firstBrick, int brickCount);
 
-    void Update();
-    void Render() const override;
-    void CheckForBreaks();  // Check if any bricks should detach
+    b2BodyId GetBodyId() const { return bodyId; }
+    int FirstBrick() const { return firstBrick; }
+    int BrickCount() const { return brickCount; }
+    
+    // Distance between the centres of neighbouring bricks, in pixels
+    static constexpr float BRICK_SPACING = 15.0f;  // Brick width * 2
 
 private:
-    Game* game;
-    std::vector<std::unique_ptr<Brick>> bricks;
-    
-    static constexpr float BREAK_THRESHOLD = 2.0f;  // Velocity threshold for breaking
+    b2BodyId bodyId;
+    int firstBrick;
+    int brickCount;
 };